@@ -0,0 +1,610 @@
+#define _DEFAULT_SOURCE	// pentru clock_gettime si getrusage
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sfl.h"
+
+/*
+	Benchmark pentru heap: fiecare scenariu ruleaza intr-un proces separat
+	(ca memoria maxima sa fie doar a lui) si apeleaza direct functiile din
+	sfl_lib.h, fara afisare. Rezultatele se afiseaza ca JSON.
+*/
+
+// heap-ul folosit de toate scenariile: 8 liste (8..1024 bytes), cate 1 MiB
+#define BENCH_ADDRESS 0x1000
+#define BENCH_LISTS 8
+#define BENCH_BYTES (1 << 20)
+#define BENCH_MAX_SIZE 1024
+
+#define BATCH 1000	// cate blocuri se aloca inainte de eliberare (LIFO/FIFO)
+#define RUNS_LIVE 4	// cate siruri de blocuri raman alocate (runs)
+#define RUN_BLOCKS 1000	// blocurile consecutive citite si scrise (rw)
+#define RUN_SIZE 512
+// heap-ul scenariilor lists_*: 13 liste (8 bytes .. 32 KiB), cate 32 MiB
+#define CLASS_LISTS 13
+#define CLASS_BYTES (32 << 20)
+#define CLASS_BLOCK 8192	// blocurile din care se taie listele noi
+// scenariul distinct: 15 liste (8 bytes .. 128 KiB), cate 256 MiB
+#define DISTINCT_LISTS 15
+#define DISTINCT_BYTES (256 << 20)
+#define DISTINCT_SIZES 100000	// cate dimensiuni diferite se cer
+#define DISTINCT_STEP 7919	// prim cu DISTINCT_SIZES, le parcurge pe toate
+#define DISTINCT_LIVE 1024
+// scenariul dump: 1M blocuri alocate de 8 bytes, cu cate unul liber intre ele
+#define DUMP_BLOCKS (1 << 20)
+#define DUMP_RUNS 10	// cate DUMP_MEMORY se cronometreaza
+
+typedef struct bench_t {
+	sfl *heap;
+	long long *latency;	// durata fiecarei operatii, in nanosecunde
+	long long nr_ops;
+	long long max_ops;
+	long long out_of_memory;
+	unsigned long long seed;
+	char *payload;	// sirul scris de WRITE
+	char *buffer;	// octetii cititi de READ
+	int type;	// tipul si politica heap-ului, pentru bench_heap
+	int policy;
+} bench_t;
+
+typedef struct workload_t {
+	const char *name;
+	void (*run)(bench_t *b);
+	int best_only;	// masoara cautarea best-fit, deci ruleaza doar cu best
+} workload_t;
+
+// opreste benchmark-ul daca un scenariu nu se comporta cum se astepta
+static void check(int ok, const char *what)
+{
+	if (!ok) {
+		fprintf(stderr, "sfl_bench: %s\n", what);
+		exit(1);
+	}
+}
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// generator xorshift, ca scenariile sa fie aceleasi de la o rulare la alta
+static unsigned int bench_rand(bench_t *b)
+{
+	b->seed ^= b->seed << 13;
+	b->seed ^= b->seed >> 7;
+	b->seed ^= b->seed << 17;
+	return b->seed >> 32;
+}
+
+/*
+	Inlocuieste heap-ul comun cu unul de nr_lists liste a cate bytes octeti,
+	pentru scenariile care au nevoie de alte dimensiuni de blocuri.
+*/
+static void bench_heap(bench_t *b, int nr_lists, sfl_addr_t bytes)
+{
+	sfl_destroy(b->heap);
+	b->heap = sfl_init(BENCH_ADDRESS, nr_lists, bytes, b->type, b->policy);
+}
+
+static int done(bench_t *b)
+{
+	return b->nr_ops >= b->max_ops;
+}
+
+static void record(bench_t *b, long long start)
+{
+	b->latency[b->nr_ops++] = now_ns() - start;
+}
+
+// n operatii facute cu o singura comanda; fiecare primeste durata medie
+static void record_n(bench_t *b, long long start, int n)
+{
+	long long each = (now_ns() - start) / n;
+	for (int i = 0; i < n; i++)
+		b->latency[b->nr_ops++] = each;
+}
+
+// MALLOC size; returneaza adresa sau SFL_OUT_OF_MEMORY
+static sfl_addr_t bench_malloc(bench_t *b, int size)
+{
+	long long start = now_ns();
+	sfl_addr_t address = sfl_malloc(b->heap, size);
+	record(b, start);
+	if (address == SFL_OUT_OF_MEMORY)
+		b->out_of_memory++;
+	return address;
+}
+
+static void bench_free(bench_t *b, sfl_addr_t address)
+{
+	long long start = now_ns();
+	sfl_free(b->heap, address);
+	record(b, start);
+}
+
+// MALLOC_N size n; returneaza cate blocuri s-au alocat
+static int bench_malloc_n(bench_t *b, int size, int n, sfl_addr_t *addresses)
+{
+	long long start = now_ns();
+	int taken = sfl_malloc_n(b->heap, size, n, addresses);
+	record_n(b, start, n);
+	b->out_of_memory = b->out_of_memory + n - taken;
+	return taken;
+}
+
+static void bench_free_n(bench_t *b, sfl_addr_t *addresses, int n)
+{
+	long long start = now_ns();
+	sfl_free_n(b->heap, addresses, n);
+	record_n(b, start, n);
+}
+
+static void bench_write(bench_t *b, sfl_addr_t address, int n)
+{
+	long long start = now_ns();
+	int error = sfl_write(b->heap, address, b->payload, n);
+	record(b, start);
+	check(error == SFL_OK, "write outside the allocated blocks");
+}
+
+static void bench_read(bench_t *b, sfl_addr_t address, int n)
+{
+	long long start = now_ns();
+	int error = sfl_read(b->heap, address, b->buffer, n);
+	record(b, start);
+	check(error == SFL_OK, "read outside the allocated blocks");
+}
+
+/*
+	Aloca si elibereaza la intamplare: cu probabilitate 1/2 se aloca un bloc
+	de dimensiune data de size(), altfel se elibereaza un bloc ales la
+	intamplare dintre cele alocate.
+*/
+static void random_mix(bench_t *b, int (*size)(bench_t *b))
+{
+	int max_live = BENCH_LISTS * BENCH_BYTES / BENCH_MAX_SIZE;
+	sfl_addr_t *live = malloc(max_live * sizeof(*live));
+	DIE(!live, "malloc failed...");
+	int nr_live = 0;
+	while (!done(b)) {
+		if (nr_live == 0 || (nr_live < max_live && bench_rand(b) % 2)) {
+			sfl_addr_t address = bench_malloc(b, size(b));
+			if (address != SFL_OUT_OF_MEMORY)
+				live[nr_live++] = address;
+		} else {
+			int i = bench_rand(b) % nr_live;
+			bench_free(b, live[i]);
+			live[i] = live[--nr_live];
+		}
+	}
+	free(live);
+}
+
+static int uniform_size(bench_t *b)
+{
+	return 1 + bench_rand(b) % BENCH_MAX_SIZE;
+}
+
+// dimensiuni cu distributie power-law: multe blocuri mici, putine mari
+static int power_law_size(bench_t *b)
+{
+	double u = (1 + bench_rand(b) % (1 << 20)) / (double)(1 << 20);
+	int size = 1 + (int)(4 / u);
+	return size < BENCH_MAX_SIZE ? size : BENCH_MAX_SIZE;
+}
+
+static void run_uniform(bench_t *b)
+{
+	random_mix(b, uniform_size);
+}
+
+static void run_power_law(bench_t *b)
+{
+	random_mix(b, power_law_size);
+}
+
+/*
+	Producator/consumator: se aloca BATCH blocuri, apoi se elibereaza toate,
+	in ordine inversa (lifo) sau in ordinea alocarii.
+*/
+static void producer_consumer(bench_t *b, int lifo)
+{
+	sfl_addr_t live[BATCH];
+	while (!done(b)) {
+		int nr_live = 0;
+		for (int i = 0; i < BATCH && !done(b); i++) {
+			sfl_addr_t address = bench_malloc(b, 1 + bench_rand(b) % 256);
+			if (address != SFL_OUT_OF_MEMORY)
+				live[nr_live++] = address;
+		}
+		for (int i = 0; i < nr_live && !done(b); i++)
+			bench_free(b, live[lifo ? nr_live - 1 - i : i]);
+	}
+}
+
+static void run_lifo(bench_t *b)
+{
+	producer_consumer(b, 1);
+}
+
+static void run_fifo(bench_t *b)
+{
+	producer_consumer(b, 0);
+}
+
+/*
+	Fragmentare: blocuri de dimensiuni impare se taie din blocurile mari, iar
+	jumatate din ele se elibereaza imediat, astfel incat raman multe bucati
+	mici intre blocurile alocate. Cand heap-ul se umple se elibereaza tot.
+*/
+static void run_fragment(bench_t *b)
+{
+	int max_live = BENCH_LISTS * BENCH_BYTES / 16;
+	sfl_addr_t *live = malloc(max_live * sizeof(*live));
+	DIE(!live, "malloc failed...");
+	int nr_live = 0;
+	while (!done(b)) {
+		sfl_addr_t first = bench_malloc(b, 1 + 2 * (bench_rand(b) % 48));
+		if (done(b))
+			break;
+		sfl_addr_t second = bench_malloc(b, 1 + 2 * (bench_rand(b) % 48));
+		if (second != SFL_OUT_OF_MEMORY)
+			live[nr_live++] = second;
+		if (first != SFL_OUT_OF_MEMORY && !done(b))
+			bench_free(b, first);
+		if (first == SFL_OUT_OF_MEMORY || second == SFL_OUT_OF_MEMORY ||
+			nr_live == max_live) {
+			while (nr_live && !done(b))
+				bench_free(b, live[--nr_live]);
+		}
+	}
+	free(live);
+}
+
+/*
+	Siruri de BATCH blocuri de aceeasi dimensiune, intre jumatate si toata
+	dimensiunea unei liste; un sir se elibereaza dupa ce s-au mai alocat
+	RUNS_LIVE siruri. Blocurile se aloca si se elibereaza pe rand (runs) sau
+	cu cate un MALLOC_N si un FREE_N pentru tot sirul (runs_batch).
+*/
+static void same_size_runs(bench_t *b, int batch)
+{
+	sfl_addr_t runs[RUNS_LIVE][BATCH];
+	int lengths[RUNS_LIVE] = {0};
+	for (int r = 0; !done(b); r = (r + 1) % RUNS_LIVE) {
+		sfl_addr_t *run = runs[r];
+		int n = lengths[r];
+		if (b->max_ops - b->nr_ops < n)
+			n = b->max_ops - b->nr_ops;
+		if (batch && n) {
+			bench_free_n(b, run, n);
+		} else {
+			for (int i = 0; i < n; i++)
+				bench_free(b, run[i]);
+		}
+
+		int capacity = 8 << bench_rand(b) % BENCH_LISTS;
+		int size = capacity / 2 + 1 + bench_rand(b) % (capacity / 2);
+		n = BATCH;
+		if (b->max_ops - b->nr_ops < n)
+			n = b->max_ops - b->nr_ops;
+		if (batch && n) {
+			lengths[r] = bench_malloc_n(b, size, n, run);
+		} else {
+			lengths[r] = 0;
+			for (int i = 0; i < n; i++) {
+				sfl_addr_t address = bench_malloc(b, size);
+				if (address != SFL_OUT_OF_MEMORY)
+					run[lengths[r]++] = address;
+			}
+		}
+	}
+}
+
+static void run_runs(bench_t *b)
+{
+	same_size_runs(b, 0);
+}
+
+static void run_runs_batch(bench_t *b)
+{
+	same_size_runs(b, 1);
+}
+
+/*
+	Citiri si scrieri mari: RUN_BLOCKS blocuri consecutive de RUN_SIZE bytes,
+	peste care se scriu si se citesc intre 4 KiB si 64 KiB deodata.
+*/
+static void run_read_write(bench_t *b)
+{
+	sfl_addr_t start = 0;
+	for (int i = 0; i < RUN_BLOCKS; i++) {
+		sfl_addr_t address = bench_malloc(b, RUN_SIZE);
+		if (i == 0)
+			start = address;
+		check(address != SFL_OUT_OF_MEMORY &&
+			  address == start + (sfl_addr_t)i * RUN_SIZE,
+			  "the read/write run is not contiguous");
+	}
+	sfl_addr_t total = (sfl_addr_t)RUN_BLOCKS * RUN_SIZE;
+	while (!done(b)) {
+		int n = 4096 + bench_rand(b) % (60 * 1024);
+		sfl_addr_t address = start + bench_rand(b) % (total - n);
+		if (bench_rand(b) % 2)
+			bench_write(b, address, n);
+		else
+			bench_read(b, address, n);
+	}
+}
+
+/*
+	Memoria listelor libere: jumatate din operatii aloca blocuri de 8 bytes
+	(cand se termina lista de 8 bytes, din blocuri mai mari, ale caror
+	resturi raman libere), iar cealalta jumatate elibereaza unul din doua
+	blocuri, de la adresele mari spre cele mici. La sfarsit listele libere au
+	multe blocuri izolate, cu adresa.
+*/
+static void run_scatter(bench_t *b)
+{
+	int max_live = b->max_ops / 2 + 1;
+	sfl_addr_t *live = malloc(max_live * sizeof(*live));
+	DIE(!live, "malloc failed...");
+	int nr_live = 0;
+	while (nr_live < max_live - 1 && !done(b)) {
+		sfl_addr_t address = bench_malloc(b, 8);
+		if (address == SFL_OUT_OF_MEMORY)
+			break;
+		live[nr_live++] = address;
+	}
+	for (int i = nr_live - 1; i >= 0 && !done(b); i -= 2)
+		bench_free(b, live[i]);
+	free(live);
+}
+
+/*
+	MALLOC cu multe liste: din blocurile de CLASS_BLOCK bytes se aloca
+	CLASS_BLOCK - r bytes, pentru r de la 1 pana cand heap-ul are nr_lists
+	liste, iar fiecare rest de r bytes ramane liber, in lista lui. Apoi se
+	cronometreaza doar MALLOC-ul unor blocuri de 8 .. 1024 bytes, care se
+	elibereaza imediat, fara sa se masoare FREE. Latenta trebuie sa ramana
+	aproape aceeasi de la 64 la 4096 de liste.
+*/
+static void size_classes(bench_t *b, int nr_lists)
+{
+	bench_heap(b, CLASS_LISTS, CLASS_BYTES);
+	for (int r = 1; r <= nr_lists - CLASS_LISTS; r++)
+		if (sfl_malloc(b->heap, CLASS_BLOCK - r) == SFL_OUT_OF_MEMORY)
+			b->out_of_memory++;
+	while (!done(b)) {
+		sfl_addr_t address = bench_malloc(b, 8 << bench_rand(b) % BENCH_LISTS);
+		if (address != SFL_OUT_OF_MEMORY)
+			sfl_free(b->heap, address);
+	}
+}
+
+/*
+	Multe dimensiuni diferite: a k-a cerere are 1 + k * DISTINCT_STEP %
+	DISTINCT_SIZES bytes, asa ca primele DISTINCT_SIZES cereri au toate
+	dimensiuni diferite. Resturile si blocurile eliberate fac liste noi, care
+	se insereaza in vectorul sortat si se scot cand raman goale. Cand sunt
+	DISTINCT_LIVE blocuri alocate, se elibereaza unul la intamplare.
+*/
+static void run_distinct(bench_t *b)
+{
+	sfl_addr_t live[DISTINCT_LIVE];
+	int nr_live = 0;
+	bench_heap(b, DISTINCT_LISTS, DISTINCT_BYTES);
+	for (long long k = 0; !done(b); k++) {
+		if (nr_live == DISTINCT_LIVE) {
+			int i = bench_rand(b) % nr_live;
+			bench_free(b, live[i]);
+			live[i] = live[--nr_live];
+			if (done(b))
+				break;
+		}
+		int size = 1 + k * DISTINCT_STEP % DISTINCT_SIZES;
+		sfl_addr_t address = bench_malloc(b, size);
+		if (address != SFL_OUT_OF_MEMORY)
+			live[nr_live++] = address;
+	}
+}
+
+/*
+	DUMP_MEMORY pe un heap cu DUMP_BLOCKS blocuri alocate si tot atatea
+	libere: se aloca toata lista de blocuri de 8 bytes si se elibereaza unul
+	din doua, de la adresele mari spre cele mici, ca fiecare sa ajunga la
+	inceputul listei lui. Fiecare operatie e un DUMP_MEMORY complet, scris in
+	/dev/null prin bufferul de iesire al programului.
+*/
+static void run_dump(bench_t *b)
+{
+	int n = 2 * DUMP_BLOCKS;
+	sfl_addr_t *blocks = malloc(n * sizeof(*blocks));
+	DIE(!blocks, "malloc failed...");
+	bench_heap(b, 1, n * 8LL);
+	check(sfl_malloc_n(b->heap, 8, n, blocks) == n, "the dump heap is full");
+	for (int i = n - 1; i > 0; i -= 2)
+		sfl_free(b->heap, blocks[i]);
+	free(blocks);
+
+	out_buf_t out;
+	out_init(&out);
+	out.fd = open("/dev/null", O_WRONLY);
+	DIE(out.fd < 0, "open failed...");
+	for (int i = 0; i < DUMP_RUNS && !done(b); i++) {
+		long long start = now_ns();
+		dump_print(&out, b->heap);
+		out_flush(&out);
+		record(b, start);
+	}
+	close(out.fd);
+	free(out.data);
+}
+
+static void run_lists_64(bench_t *b)
+{
+	size_classes(b, 64);
+}
+
+static void run_lists_512(bench_t *b)
+{
+	size_classes(b, 512);
+}
+
+static void run_lists_4096(bench_t *b)
+{
+	size_classes(b, 4096);
+}
+
+static const workload_t workloads[] = {
+	{"uniform", run_uniform, 0},
+	{"power_law", run_power_law, 0},
+	{"lifo", run_lifo, 0},
+	{"fifo", run_fifo, 0},
+	{"fragment", run_fragment, 0},
+	{"read_write", run_read_write, 0},
+	{"runs", run_runs, 0},
+	{"runs_batch", run_runs_batch, 0},
+	{"scatter", run_scatter, 0},
+	{"distinct", run_distinct, 0},
+	{"dump", run_dump, 0},
+	{"lists_64", run_lists_64, 1},
+	{"lists_512", run_lists_512, 1},
+	{"lists_4096", run_lists_4096, 1}
+};
+
+static int compare_ll(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+	return (x > y) - (x < y);
+}
+
+static const char *policies[] = {"best", "first", "next", "tlsf"};
+
+// ruleaza un scenariu pe un heap nou si afiseaza rezultatul ca obiect JSON
+static void run_workload(const workload_t *w, long long max_ops, int type,
+						 int policy)
+{
+	bench_t b;
+	memset(&b, 0, sizeof(b));
+	b.max_ops = max_ops;
+	b.seed = 0x9e3779b97f4a7c15ULL;
+	b.type = type;
+	b.policy = policy;
+	b.latency = malloc(max_ops * sizeof(long long));
+	b.payload = malloc(64 * 1024);
+	b.buffer = malloc(64 * 1024);
+	DIE(!b.latency || !b.payload || !b.buffer, "malloc failed...");
+	memset(b.payload, 'x', 64 * 1024);
+
+	b.heap = sfl_init(BENCH_ADDRESS, BENCH_LISTS, BENCH_BYTES, type, policy);
+
+	long long start = now_ns();
+	w->run(&b);
+	double seconds = (now_ns() - start) / 1e9;
+	double fragmentation = fragmentation_ratio(b.heap);
+	long long free_lists = free_list_bytes(b.heap);
+	/*
+		interna: octetii din blocurile alocate peste cat s-a cerut (doar in
+		modul buddy); externa: cat din memoria libera nu mai poate servi o
+		cerere de BENCH_MAX_SIZE octeti
+	*/
+	sfl_stats_t stats;
+	sfl_stats(b.heap, &stats);
+	double internal = 0, external = 0;
+	if (stats.allocated_bytes)
+		internal = (double)(stats.allocated_bytes - stats.requested_bytes) /
+				   stats.allocated_bytes;
+	if (stats.free_bytes)
+		external = 1 - (double)free_bytes_from(b.heap, BENCH_MAX_SIZE) /
+					   stats.free_bytes;
+
+	qsort(b.latency, b.nr_ops, sizeof(long long), compare_ll);
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	printf("    {\"name\": \"%s\", \"policy\": \"%s\", \"ops\": %lld, "
+		   "\"seconds\": %.6f, "
+		   "\"ops_per_sec\": %.0f, \"p50_ns\": %lld, \"p99_ns\": %lld, "
+		   "\"peak_rss_kb\": %ld, \"free_list_kb\": %lld, "
+		   "\"fragmentation\": %.4f, \"internal_fragmentation\": %.4f, "
+		   "\"external_fragmentation\": %.4f, \"out_of_memory\": %lld}",
+		   w->name, policies[policy], b.nr_ops, seconds, b.nr_ops / seconds,
+		   b.latency[b.nr_ops / 2], b.latency[b.nr_ops * 99 / 100],
+		   usage.ru_maxrss, free_lists / 1024, fragmentation, internal,
+		   external, b.out_of_memory);
+	fflush(stdout);
+
+	sfl_destroy(b.heap);
+	free(b.latency);
+	free(b.payload);
+	free(b.buffer);
+}
+
+/*
+	sfl_bench [ops] [type] [workload... | policy...]
+	ops: operatiile fiecarui scenariu (implicit 200000), type: tipul
+	heap-ului ca la INIT_HEAP; fara nume se ruleaza toate scenariile, cu
+	toate politicile de plasare. Modul buddy (type 2) are o singura politica,
+	asa ca ruleaza doar cu best, ca si scenariile lists_*.
+*/
+int main(int argc, char **argv)
+{
+	long long max_ops = argc > 1 ? atoll(argv[1]) : 200000;
+	int type = argc > 2 ? atoi(argv[2]) : 0;
+	int nr_workloads = sizeof(workloads) / sizeof(workloads[0]);
+	int nr_policies = sizeof(policies) / sizeof(policies[0]);
+	int selected[sizeof(workloads) / sizeof(workloads[0])] = {0};
+	int chosen[sizeof(policies) / sizeof(policies[0])] = {0};
+	int any_workload = 0, any_policy = 0, first = 1;
+	if (max_ops < 1)
+		max_ops = 1;
+	for (int j = 3; j < argc; j++) {
+		int policy = policy_by_name(argv[j], strlen(argv[j]));
+		if (policy != -1) {
+			chosen[policy] = any_policy = 1;
+			continue;
+		}
+		for (int i = 0; i < nr_workloads; i++)
+			if (strcmp(argv[j], workloads[i].name) == 0)
+				selected[i] = any_workload = 1;
+	}
+
+	printf("{\n  \"heap\": {\"lists\": %d, \"bytes_per_list\": %d, "
+		   "\"type\": %d},\n  \"workloads\": [\n",
+		   BENCH_LISTS, BENCH_BYTES, type);
+	for (int i = 0; i < nr_workloads; i++) {
+		for (int policy = 0; policy < nr_policies; policy++) {
+			if ((any_workload && !selected[i]) ||
+				(any_policy && !chosen[policy]) ||
+				((type == 2 || workloads[i].best_only) &&
+				 policy != POLICY_BEST))
+				continue;
+
+			if (!first)
+				printf(",\n");
+			first = 0;
+			fflush(stdout);
+			pid_t pid = fork();
+			DIE(pid < 0, "fork failed...");
+			if (pid == 0) {
+				run_workload(&workloads[i], max_ops, type, policy);
+				exit(0);
+			}
+			int status;
+			waitpid(pid, &status, 0);
+			check(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+				  workloads[i].name);
+		}
+	}
+	printf("\n  ]\n}\n");
+	return 0;
+}
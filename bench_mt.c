@@ -0,0 +1,203 @@
+#define _DEFAULT_SOURCE	// pentru clock_gettime
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sfl.h"
+
+/*
+	Benchmark pentru heap-ul cu mai multe fire (sfl_mt.c). Pentru 1, 2, 4,
+	..., 64 de fire, fiecare fir face acelasi numar de alocari si eliberari
+	de blocuri din clasele create de create_list_vector; o parte din blocuri
+	sunt trimise firului urmator si eliberate de acesta (eliberari din alt
+	fir). Se compara arenele cu cache pe fir cu o singura arena fara cache,
+	adica un heap cu un singur lacat. Pentru contentie, aceeasi arena fara
+	cache se ruleaza si cu stivele fara lacat, atat pe toate clasele cat si
+	pe o singura clasa folosita de toate firele (hot). Rezultatele se
+	afiseaza ca JSON.
+*/
+
+#define MT_ADDRESS 0x1000
+#define MT_LISTS 8	// clase de 8..1024 octeti
+#define MT_BYTES (8 << 20)	// octeti pe lista, pentru tot heap-ul
+#define MT_CACHE 32
+#define MAX_THREADS 64
+#define LIVE 256	// cate blocuri tine un fir in acelasi timp
+#define RING 1024	// blocuri trimise altui fir, inca neeliberate
+#define HOT_SIZE 64	// dimensiunea blocurilor din scenariul hot
+
+// coada cu un singur producator si un singur consumator
+typedef struct ring_t {
+	int blocks[RING];
+	int head;	// scris doar de consumator
+	int tail;	// scris doar de producator
+} ring_t;
+
+typedef struct worker_t {
+	pthread_t thread;
+	sfl_mt_t *mt;
+	int hot;	// toate blocurile au HOT_SIZE octeti
+	long long ops;
+	long long failed;
+	unsigned long long seed;
+	ring_t *inbox;	// blocuri primite de la firul anterior
+	ring_t *outbox;	// inbox-ul firului urmator
+} worker_t;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static unsigned int next_rand(worker_t *w)
+{
+	w->seed ^= w->seed << 13;
+	w->seed ^= w->seed >> 7;
+	w->seed ^= w->seed << 17;
+	return w->seed >> 32;
+}
+
+static int ring_push(ring_t *ring, int address)
+{
+	int tail = ring->tail;
+	if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == RING)
+		return 0;
+	ring->blocks[tail % RING] = address;
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+static int ring_pop(ring_t *ring, int *address)
+{
+	int head = ring->head;
+	if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+		return 0;
+	*address = ring->blocks[head % RING];
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+// dimensiuni de la 1 la 1024 octeti, mai des mici
+static int block_size(worker_t *w)
+{
+	if (w->hot)
+		return HOT_SIZE;
+	int c = next_rand(w) % (MT_LISTS * 2);
+	c = c < MT_LISTS ? c / 2 : c - MT_LISTS;
+	return 1 + next_rand(w) % (8 << c);
+}
+
+static void *worker(void *data)
+{
+	worker_t *w = data;
+	int live[LIVE], nr_live = 0;
+	for (long long i = 0; i < w->ops; i++) {
+		int address;
+		if (ring_pop(w->inbox, &address)) {
+			// bloc alocat de alt fir
+			if (sfl_mt_free(w->mt, address) == -1)
+				w->failed++;
+		} else if (nr_live < LIVE && (nr_live == 0 || next_rand(w) % 2)) {
+			address = sfl_mt_malloc(w->mt, block_size(w));
+			if (address == -1)
+				w->failed++;
+			else
+				live[nr_live++] = address;
+		} else {
+			int j = next_rand(w) % nr_live;
+			address = live[j];
+			live[j] = live[--nr_live];
+			// unul din opt blocuri e eliberat de firul urmator
+			if (next_rand(w) % 8 || !ring_push(w->outbox, address)) {
+				if (sfl_mt_free(w->mt, address) == -1)
+					w->failed++;
+			}
+		}
+	}
+	while (nr_live)
+		sfl_mt_free(w->mt, live[--nr_live]);
+	return NULL;
+}
+
+static const char *lists_name[] = {"sorted", "stacks"};
+
+// ruleaza nr_threads fire pe un heap nou si afiseaza rezultatul
+static void run(int nr_threads, int hot, int lists, int nr_arenas,
+				int cache_size, long long ops)
+{
+	sfl_mt_t *mt = sfl_mt_create(MT_ADDRESS, MT_LISTS, MT_BYTES, 0, lists,
+								 nr_arenas, cache_size);
+	DIE(!mt, "sfl_mt_create failed...");
+	worker_t *workers = calloc(nr_threads, sizeof(worker_t));
+	ring_t *rings = calloc(nr_threads, sizeof(ring_t));
+	DIE(!workers || !rings, "calloc failed...");
+
+	for (int i = 0; i < nr_threads; i++) {
+		workers[i].mt = mt;
+		workers[i].hot = hot;
+		workers[i].ops = ops;
+		workers[i].seed = 0x9e3779b97f4a7c15ULL * (i + 1);
+		workers[i].inbox = &rings[i];
+		workers[i].outbox = &rings[(i + 1) % nr_threads];
+	}
+	long long start = now_ns();
+	for (int i = 0; i < nr_threads; i++)
+		DIE(pthread_create(&workers[i].thread, NULL, worker, &workers[i]),
+			"pthread_create failed...");
+	for (int i = 0; i < nr_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+	double seconds = (now_ns() - start) / 1e9;
+
+	// blocurile ramase in cozi dupa oprirea firelor
+	long long failed = 0;
+	for (int i = 0; i < nr_threads; i++) {
+		int address;
+		while (ring_pop(&rings[i], &address))
+			sfl_mt_free(mt, address);
+		failed = failed + workers[i].failed;
+	}
+	printf("    {\"workload\": \"%s\", \"threads\": %d, \"lists\": \"%s\", "
+		   "\"arenas\": %d, \"cache\": %d, \"ops\": %lld, "
+		   "\"seconds\": %.6f, \"ops_per_sec\": %.0f, \"failed\": %lld}",
+		   hot ? "hot" : "mixed", nr_threads, lists_name[lists], nr_arenas,
+		   cache_size, ops * nr_threads, seconds, ops * nr_threads / seconds,
+		   failed);
+	sfl_mt_destroy(mt);
+	free(workers);
+	free(rings);
+}
+
+/*
+	sfl_bench_mt [ops]
+	ops: operatiile fiecarui fir (implicit 200000)
+*/
+int main(int argc, char **argv)
+{
+	long long ops = argc > 1 ? atoll(argv[1]) : 200000;
+	if (ops < 1)
+		ops = 1;
+
+	printf("{\n  \"lists\": %d, \"bytes_per_list\": %d,\n  \"runs\": [\n",
+		   MT_LISTS, MT_BYTES);
+	for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+		for (int hot = 0; hot <= 1; hot++) {
+			// un singur lacat, fara cache
+			run(threads, hot, SFL_MT_SORTED, 1, 0, ops);
+			printf(",\n");
+			// aceeasi arena, cu stive fara lacat
+			run(threads, hot, SFL_MT_STACKS, 1, 0, ops);
+			printf(",\n");
+		}
+		// cate o arena pe fir, cu cache
+		run(threads, 0, SFL_MT_SORTED, threads, MT_CACHE, ops);
+		printf(threads < MAX_THREADS ? ",\n" : "\n");
+		fflush(stdout);
+	}
+	printf("  ]\n}\n");
+	return 0;
+}
@@ -0,0 +1,518 @@
+#define _DEFAULT_SOURCE	// pentru clock_gettime
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sfl.h"
+
+// timpul pentru latentele comenzilor, in nanosecunde
+static long long clock_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// numele fisierului unui snapshot, terminat cu '\0'
+static char *command_path(command_t *cmd)
+{
+	char *path = malloc(cmd->length + 1);
+	DIE(!path, "malloc failed...");
+	memcpy(path, cmd->string, cmd->length);
+	path[cmd->length] = '\0';
+	return path;
+}
+
+// afiseaza message de n ori
+static void out_repeat(out_buf_t *out, const char *message, int n)
+{
+	for (int i = 0; i < n; i++)
+		out_str(out, message);
+}
+
+/*
+	READ: octetii se copiaza din heap in bucati de cel mult OUT_SIZE, dupa
+	ce s-a verificat toata zona. Returneaza SFL_SEGFAULT fara sa afiseze
+	nimic daca zona nu e alocata.
+*/
+static int read_command(out_buf_t *out, sfl *heap, command_t *cmd)
+{
+	static char chunk[OUT_SIZE];
+	if (sfl_read(heap, cmd->address, NULL, cmd->nr_bytes) != SFL_OK)
+		return SFL_SEGFAULT;
+	for (sfl_addr_t done = 0; done < cmd->nr_bytes; done += OUT_SIZE) {
+		sfl_addr_t n = cmd->nr_bytes - done < OUT_SIZE ? cmd->nr_bytes - done
+													  : OUT_SIZE;
+		sfl_read(heap, cmd->address + done, chunk, n);
+		out_bytes(out, chunk, n);
+	}
+	out_char(out, '\n');
+	return SFL_OK;
+}
+
+/*
+	Executa o comanda pe heap-ul *heap, pe care INIT_HEAP si LOAD_SNAPSHOT
+	il inlocuiesc. Returneaza 0 daca executia trebuie oprita.
+*/
+static int run_command(out_buf_t *out, sfl **heap, command_t *cmd,
+					   command_stats_t *stats)
+{
+	// adresele lui MALLOC_N nu se folosesc, asa ca se aloca pe grupuri
+	static sfl_addr_t batch[BATCH_SIZE];
+	sfl_addr_t n;
+	int got;
+	if (!*heap && cmd->type != CMD_INIT_HEAP && cmd->type != CMD_STATS &&
+		cmd->type != CMD_LOAD_SNAPSHOT && cmd->type != CMD_DESTROY_HEAP)
+		return 1;	// comanda are nevoie de un heap
+	switch (cmd->type) {
+	case CMD_INIT_HEAP:
+		if (*heap)
+			sfl_destroy(*heap);
+		*heap = sfl_init(cmd->address, cmd->nr_lists, cmd->nr_bytes,
+						 cmd->heap_type, cmd->policy);
+		if (cmd->huge_bytes)
+			sfl_huge_init(*heap, cmd->huge_threshold, cmd->huge_bytes);
+		break;
+	case CMD_MALLOC:
+		if (sfl_malloc(*heap, cmd->nr_bytes) == SFL_OUT_OF_MEMORY)
+			out_str(out, "Out of memory\n");
+		break;
+	case CMD_FREE:
+		if (sfl_free(*heap, cmd->address) != SFL_OK)
+			out_str(out, "Invalid free\n");
+		break;
+	case CMD_READ:
+		if (read_command(out, *heap, cmd) != SFL_OK) {
+			out_str(out, "Segmentation fault (core dumped)\n");
+			dump_print(out, *heap);
+			return 0;
+		}
+		break;
+	case CMD_WRITE:
+		// se scriu cel mult atatia octeti cati are sirul
+		n = cmd->nr_bytes < cmd->length ? cmd->nr_bytes : cmd->length;
+		if (sfl_write(*heap, cmd->address, cmd->string, n) != SFL_OK) {
+			out_str(out, "Segmentation fault (core dumped)\n");
+			dump_print(out, *heap);
+			return 0;
+		}
+		break;
+	case CMD_DUMP_MEMORY:
+		dump_print(out, *heap);
+		break;
+	case CMD_DUMP_DELTA:
+		delta_print(out, *heap);
+		break;
+	case CMD_DESTROY_HEAP:
+		return 0;
+	case CMD_MALLOC_N:
+		for (int done = 0; done < cmd->count; done += BATCH_SIZE) {
+			int count = cmd->count - done < BATCH_SIZE ? cmd->count - done
+													   : BATCH_SIZE;
+			got = sfl_malloc_n(*heap, cmd->nr_bytes, count, batch);
+			out_repeat(out, "Out of memory\n", count - got);
+		}
+		break;
+	case CMD_FREE_N:
+		got = sfl_free_n(*heap, cmd->addresses, cmd->count);
+		out_repeat(out, "Invalid free\n", cmd->count - got);
+		break;
+	case CMD_STATS:
+		if (cmd->json)
+			stats_print_json(out, *heap, stats);
+		else
+			stats_print(out, *heap, stats);
+		break;
+	case CMD_SAVE_SNAPSHOT: {
+		char *path = command_path(cmd);
+		if (sfl_save_snapshot(*heap, path) != SFL_OK)
+			out_str(out, "Cannot save snapshot\n");
+		free(path);
+		break;
+	}
+	case CMD_LOAD_SNAPSHOT: {
+		char *path = command_path(cmd);
+		sfl *loaded = sfl_load_snapshot(path);
+		free(path);
+		if (!loaded) {
+			out_str(out, "Invalid snapshot\n");
+			break;
+		}
+		if (*heap)
+			sfl_destroy(*heap);
+		*heap = loaded;
+		break;
+	}
+	}
+	return 1;
+}
+
+// executa o comanda si ii masoara latenta; returneaza 0 daca trebuie oprit
+static int execute(out_buf_t *out, sfl **heap, command_t *cmd,
+				   command_stats_t *stats)
+{
+	int timed = stats_sample(stats, cmd->type);
+	long long start = timed ? clock_ns() : 0;
+	int running = run_command(out, heap, cmd, stats);
+	if (timed)
+		stats_latency(stats, cmd->type, clock_ns() - start);
+	return running;
+}
+
+// executa comenzile pe rand, in firul principal
+static void replay(in_buf_t *in, out_buf_t *out, sfl **heap,
+				   command_stats_t *stats)
+{
+	command_t cmd;
+	command_init(&cmd);
+	int running = 1;
+	while (running && next_command(in, &cmd)) {
+		running = execute(out, heap, &cmd, stats);
+		// la terminal raspunsul apare imediat, altfel cand se umple bufferul
+		if (out->interactive)
+			out_flush(out);
+	}
+	command_free(&cmd);
+}
+
+/*
+	--pipeline: un fir citeste comenzile in loturi de PIPE_BATCH, firul
+	principal le executa, iar un al treilea fir scrie la iesire bufferele
+	pline. Loturile si bufferele circula prin inele cu un singur producator
+	si un singur consumator: cele pline spre etapa urmatoare, cele goale
+	inapoi. Exista cate PIPE_SLOTS din fiecare, asa ca inelele (de
+	RING_SIZE locuri) nu se umplu niciodata, iar o etapa asteapta doar cand
+	inelul ei e gol: putin activ, apoi blocata pe variabila de conditie a
+	inelului, ca o intrare care vine incet sa nu tina procesoarele ocupate.
+	Textul se formateaza tot la executie, pentru ca DUMP_MEMORY si READ
+	citesc heap-ul de atunci; ordinea iesirii e aceeasi pentru ca un singur
+	fir executa si bufferele se scriu in ordine.
+
+	Cititorul se opreste singur dupa DESTROY_HEAP. Cand executia se opreste
+	mai devreme (READ sau WRITE in afara blocurilor), cititorul poate fi
+	blocat in read pe o intrare inca deschisa, asa ca se anuleaza; el poate
+	fi anulat doar cat citeste intrarea.
+*/
+#define PIPE_SLOTS 8
+#define PIPE_BATCH 1024
+#define RING_SIZE 16	// putere a lui 2, mai mare decat PIPE_SLOTS
+#define PIPE_SPINS 64	// cate verificari inainte de asteptarea blocanta
+#define CACHE_LINE 64
+
+typedef struct ring_t {
+	unsigned int head;	// scris doar de consumator
+	char pad_head[CACHE_LINE - sizeof(unsigned int)];
+	unsigned int tail;	// scris doar de producator
+	char pad_tail[CACHE_LINE - sizeof(unsigned int)];
+	void *slots[RING_SIZE];
+	pthread_mutex_t lock;	// doar pentru asteptarea pe inelul gol
+	pthread_cond_t nonempty;
+} ring_t;
+
+// un lot de comenzi citite; sirurile se copiaza daca intrarea nu e mapata
+typedef struct batch_t {
+	command_t cmds[PIPE_BATCH];
+	int count;
+	int last;	// intrarea s-a terminat dupa acest lot
+	size_t offsets[PIPE_BATCH];	// unde incepe sirul fiecarei comenzi
+	char *strings;
+	size_t len, size;
+} batch_t;
+
+typedef struct pipeline_t {
+	in_buf_t *in;
+	int stop;	// executia s-a oprit, cititorul nu mai are de ce continua
+	ring_t full_batches, free_batches;
+	ring_t full_chunks, free_chunks;	// NULL in full_chunks incheie iesirea
+	batch_t *batches;
+	out_buf_t chunks[PIPE_SLOTS];
+} pipeline_t;
+
+static void ring_init(ring_t *ring)
+{
+	DIE(pthread_mutex_init(&ring->lock, NULL), "pthread_mutex_init");
+	DIE(pthread_cond_init(&ring->nonempty, NULL), "pthread_cond_init");
+}
+
+static void ring_destroy(ring_t *ring)
+{
+	pthread_mutex_destroy(&ring->lock);
+	pthread_cond_destroy(&ring->nonempty);
+}
+
+/*
+	Trezeste consumatorul daca asteapta. Se semnaleaza sub lacat, dupa ce
+	tail s-a schimbat, asa ca un consumator care tocmai a gasit inelul gol
+	fie vede elementul nou, fie primeste semnalul.
+*/
+static void ring_wake(ring_t *ring)
+{
+	pthread_mutex_lock(&ring->lock);
+	pthread_cond_broadcast(&ring->nonempty);
+	pthread_mutex_unlock(&ring->lock);
+}
+
+static void ring_push(ring_t *ring, void *item)
+{
+	unsigned int tail = ring->tail;
+	ring->slots[tail % RING_SIZE] = item;
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+	ring_wake(ring);
+}
+
+// 1 daca inelul e gol si nu trebuie oprita asteptarea
+static int ring_idle(ring_t *ring, unsigned int head, int *stop)
+{
+	return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head &&
+		   !(stop && __atomic_load_n(stop, __ATOMIC_ACQUIRE));
+}
+
+// urmatorul element; NULL daca inelul e gol si *stop a devenit 1
+static void *ring_pop(ring_t *ring, int *stop)
+{
+	unsigned int head = ring->head;
+	for (int spins = 0; spins < PIPE_SPINS && ring_idle(ring, head, stop);)
+		spins++;
+	if (ring_idle(ring, head, stop)) {
+		pthread_mutex_lock(&ring->lock);
+		while (ring_idle(ring, head, stop))
+			pthread_cond_wait(&ring->nonempty, &ring->lock);
+		pthread_mutex_unlock(&ring->lock);
+	}
+	if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head)
+		return NULL;
+	void *item = ring->slots[head % RING_SIZE];
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	return item;
+}
+
+static int has_string(command_t *cmd)
+{
+	return cmd->type == CMD_WRITE || cmd->type == CMD_SAVE_SNAPSHOT ||
+		   cmd->type == CMD_LOAD_SNAPSHOT;
+}
+
+// copiaza sirul comenzii k in lot, inainte ca bufferul intrarii sa se mute
+static void keep_string(batch_t *batch, int k)
+{
+	command_t *cmd = &batch->cmds[k];
+	if (batch->len + cmd->length > batch->size) {
+		while (batch->len + cmd->length > batch->size)
+			batch->size = batch->size ? 2 * batch->size : OUT_SIZE;
+		batch->strings = realloc(batch->strings, batch->size);
+		DIE(!batch->strings, "realloc failed...");
+	}
+	memcpy(batch->strings + batch->len, cmd->string, cmd->length);
+	batch->offsets[k] = batch->len;
+	batch->len = batch->len + cmd->length;
+}
+
+// etapa de citire: umple loturile goale pana la sfarsitul intrarii
+/*
+	1 daca urmatoarea comanda nu e toata in buffer si citirea ei poate
+	astepta dupa read: in text nu mai e nicio linie intreaga, iar in
+	formatul binar bufferul s-a golit.
+*/
+static int input_waits(in_buf_t *in)
+{
+	if (in->mapped || in->eof)
+		return 0;
+	if (in->binary)
+		return in->pos == in->len;
+	return !memchr(in->data + in->pos, '\n', in->len - in->pos);
+}
+
+static void *parse_stage(void *arg)
+{
+	pipeline_t *p = arg;
+	batch_t *batch;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	while ((batch = ring_pop(&p->free_batches, &p->stop))) {
+		batch->count = 0;
+		batch->len = 0;
+		batch->last = 0;
+		// singurul punct de anulare de aici e read, in next_command
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		while (batch->count < PIPE_BATCH && !batch->last) {
+			// comenzile citite nu asteapta dupa restul intrarii
+			if (batch->count && input_waits(p->in))
+				break;
+			command_t *cmd = &batch->cmds[batch->count];
+			if (!next_command(p->in, cmd)) {
+				batch->last = 1;
+				break;
+			}
+			if (cmd->type == CMD_NONE)
+				continue;
+			if (!p->in->mapped && has_string(cmd))
+				keep_string(batch, batch->count);
+			// executia se opreste la DESTROY_HEAP, nu mai citim intrarea
+			batch->last = cmd->type == CMD_DESTROY_HEAP;
+			batch->count++;
+		}
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+		for (int i = 0; i < batch->count && !p->in->mapped; i++)
+			if (has_string(&batch->cmds[i]))
+				batch->cmds[i].string = batch->strings + batch->offsets[i];
+		ring_push(&p->full_batches, batch);
+		if (batch->last)
+			break;
+	}
+	return NULL;
+}
+
+// etapa de afisare: scrie bufferele pline in ordinea in care vin
+static void *write_stage(void *arg)
+{
+	pipeline_t *p = arg;
+	out_buf_t *chunk;
+	while ((chunk = ring_pop(&p->full_chunks, NULL))) {
+		write_all(chunk->fd, chunk->data, chunk->len);
+		ring_push(&p->free_chunks, chunk);
+	}
+	return NULL;
+}
+
+// sink-ul executiei: bufferul plin pleaca la afisare, in schimbul unuia gol
+static void pipe_sink(out_buf_t *out)
+{
+	pipeline_t *p = out->sink_data;
+	if (!out->len)
+		return;
+	out_buf_t *chunk = ring_pop(&p->free_chunks, NULL);
+	char *empty = chunk->data;
+	chunk->data = out->data;
+	chunk->len = out->len;
+	out->data = empty;
+	ring_push(&p->full_chunks, chunk);
+}
+
+// ca replay, dar cu citirea si afisarea in fire separate
+static void replay_pipelined(in_buf_t *in, out_buf_t *out, sfl **heap,
+							 command_stats_t *stats)
+{
+	pipeline_t *p = calloc(1, sizeof(*p));
+	DIE(!p, "calloc failed...");
+	p->batches = calloc(PIPE_SLOTS, sizeof(batch_t));
+	DIE(!p->batches, "calloc failed...");
+	p->in = in;
+	ring_init(&p->full_batches);
+	ring_init(&p->free_batches);
+	ring_init(&p->full_chunks);
+	ring_init(&p->free_chunks);
+	for (int i = 0; i < PIPE_SLOTS; i++) {
+		for (int j = 0; j < PIPE_BATCH; j++)
+			command_init(&p->batches[i].cmds[j]);
+		ring_push(&p->free_batches, &p->batches[i]);
+		out_init(&p->chunks[i]);
+		p->chunks[i].fd = out->fd;
+		ring_push(&p->free_chunks, &p->chunks[i]);
+	}
+	out->sink = pipe_sink;
+	out->sink_data = p;
+	pthread_t parser, writer;
+	DIE(pthread_create(&parser, NULL, parse_stage, p), "pthread_create");
+	DIE(pthread_create(&writer, NULL, write_stage, p), "pthread_create");
+
+	int running = 1;
+	while (running) {
+		batch_t *batch = ring_pop(&p->full_batches, NULL);
+		for (int i = 0; i < batch->count && running; i++)
+			running = execute(out, heap, &batch->cmds[i], stats);
+		if (batch->last)
+			running = 0;
+		ring_push(&p->free_batches, batch);
+	}
+	__atomic_store_n(&p->stop, 1, __ATOMIC_RELEASE);
+	ring_wake(&p->free_batches);
+	pthread_cancel(parser);
+	out_flush(out);
+	ring_push(&p->full_chunks, NULL);
+	pthread_join(writer, NULL);
+	pthread_join(parser, NULL);
+	out->sink = NULL;
+	ring_destroy(&p->full_batches);
+	ring_destroy(&p->free_batches);
+	ring_destroy(&p->full_chunks);
+	ring_destroy(&p->free_chunks);
+
+	for (int i = 0; i < PIPE_SLOTS; i++) {
+		for (int j = 0; j < PIPE_BATCH; j++)
+			command_free(&p->batches[i].cmds[j]);
+		free(p->batches[i].strings);
+		free(p->chunks[i].data);
+	}
+	free(p->batches);
+	free(p);
+}
+
+/*
+	Fara argumente comenzile se citesc ca text de la intrarea standard.
+		--replay [file.bin]	executa un trace binar (implicit de la intrare)
+		--to-binary		converteste comenzile text in trace binar
+		--to-text		converteste un trace binar in comenzi text
+		--parse-only		doar citeste comenzile (text sau binare) si le
+						numara
+	Cu --pipeline inaintea lor (sau singur, pentru text), citirea, executia
+	si afisarea ruleaza in trei fire.
+*/
+int main(int argc, char **argv)
+{
+	in_buf_t in;
+	int pipelined = argc > 1 && strcmp(argv[1], "--pipeline") == 0;
+	if (pipelined) {
+		argc--;
+		argv++;
+	}
+	int fd = STDIN_FILENO;
+	char *mode = argc > 1 ? argv[1] : "";
+	if (strcmp(mode, "--replay") == 0 && argc > 2) {
+		fd = open(argv[2], O_RDONLY);
+		DIE(fd < 0, "open failed...");
+	}
+	in_init(&in, fd);
+	if (strcmp(mode, "--parse-only") == 0) {
+		in.binary = trace_header(&in);	// merge si pentru trace-uri binare
+		parse_only(&in);
+		in_free(&in);
+		return 0;
+	}
+	if (strcmp(mode, "--replay") == 0 || strcmp(mode, "--to-text") == 0) {
+		in.binary = 1;
+		if (!trace_header(&in)) {
+			fprintf(stderr, "Not an sfl binary trace\n");
+			in_free(&in);
+			return 1;
+		}
+	}
+	if (strcmp(mode, "--to-binary") == 0 || strcmp(mode, "--to-text") == 0) {
+		convert_trace(&in);
+		in_free(&in);
+		return 0;
+	}
+
+	out_buf_t out;
+	out_init(&out);
+	// contoarele si latentele comenzilor raman de la un heap la altul
+	command_stats_t stats;
+	memset(&stats, 0, sizeof(stats));
+	sfl *heap = NULL;
+	// la terminal raspunsurile trebuie afisate imediat, fara loturi
+	if (pipelined && !out.interactive)
+		replay_pipelined(&in, &out, &heap, &stats);
+	else
+		replay(&in, &out, &heap, &stats);
+	out_flush(&out);
+	free(out.data);
+	// eliberam memoria
+	if (heap)
+		sfl_destroy(heap);
+	in_free(&in);
+
+	return 0;
+}
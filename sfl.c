@@ -1,42 +1,188 @@
+#define _DEFAULT_SOURCE	// pentru MAP_ANONYMOUS si MAP_NORESERVE
+
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sfl.h"
+
+#define WORD_BITS 64
+// cate blocuri alocate se sar inainte de o noua cautare in arbore
+#define MERGE_STEPS 16
+// cate distante are cel mai mic vector de distante al unei liste libere
+#define MIN_OFFSETS 16
+// cate schimbari incap in jurnalul lui DUMP_DELTA inainte de prima marire
+#define MIN_CHANGES 1024
+
+// initializeaza o zona pentru elemente de item_size octeti
+void pool_init(pool_t *pool, int item_size)
+{
+	pool->free_items = NULL;
+	pool->slabs = NULL;
+	pool->nr_slabs = 0;
+	pool->max_slabs = 0;
+	pool->used = SLAB_ITEMS;	// nu exista inca un slab din care sa dam
+	pool->item_size = item_size;
+}
+
+// returneaza un element din zona, refolosind mai intai elementele eliberate
+void *pool_alloc(pool_t *pool)
+{
+	if (pool->free_items) {
+		void *item = pool->free_items;
+		pool->free_items = *(void **)item;
+		return item;
+	}
+
+	if (pool->used == SLAB_ITEMS) {	// ultimul slab s-a terminat
+		if (pool->nr_slabs == pool->max_slabs) {
+			pool->max_slabs = pool->max_slabs ? 2 * pool->max_slabs : 16;
+			pool->slabs = realloc(pool->slabs,
+								  pool->max_slabs * sizeof(*pool->slabs));
+			DIE(!pool->slabs, "realloc failed...");
+		}
+		pool->slabs[pool->nr_slabs] = malloc(SLAB_ITEMS * pool->item_size);
+		DIE(!pool->slabs[pool->nr_slabs], "malloc failed...");
+		pool->nr_slabs++;
+		pool->used = 0;
+	}
+	return pool->slabs[pool->nr_slabs - 1] + pool->item_size * pool->used++;
+}
+
+// pune un element inapoi in zona, ca sa fie refolosit
+void pool_free(pool_t *pool, void *item)
+{
+	*(void **)item = pool->free_items;
+	pool->free_items = item;
+}
+
+// elibereaza dintr-o data toate slab-urile zonei
+void pool_destroy(pool_t *pool)
+{
+	for (int i = 0; i < pool->nr_slabs; i++)
+		free(pool->slabs[i]);
+	free(pool->slabs);
+	pool_init(pool, pool->item_size);
+}
+
+// pregateste bufferul de afisare
+void out_init(out_buf_t *out)
+{
+	out->data = malloc(OUT_SIZE);
+	DIE(!out->data, "malloc failed...");
+	out->len = 0;
+	out->fd = STDOUT_FILENO;
+	out->interactive = isatty(STDIN_FILENO);
+	out->sink = NULL;
+	out->sink_data = NULL;
+}
+
+/*
+	scrie n octeti in fd, reluand apelul write pana se scriu toti; pentru fd
+	negativ textul se arunca. Returneaza -1 daca write esueaza.
+*/
+static int try_write(int fd, const char *s, size_t n)
+{
+	while (fd >= 0 && n > 0) {
+		ssize_t ret = write(fd, s, n);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return -1;
+		s = s + ret;
+		n = n - ret;
+	}
+	return 0;
+}
+
+// ca try_write, dar o eroare opreste programul
+void write_all(int fd, const char *s, size_t n)
+{
+	DIE(try_write(fd, s, n) < 0, "write failed...");
+}
+
+// trimite la iesire tot ce se afla in buffer
+void out_flush(out_buf_t *out)
+{
+	if (out->sink)
+		out->sink(out);
+	else
+		write_all(out->fd, out->data, out->len);
+	out->len = 0;
+}
+
+/*
+	adauga n octeti; un sir mai lung decat bufferul se scrie direct, iar
+	printr-un sink trece in bucati de cate un buffer
+*/
+void out_bytes(out_buf_t *out, const char *s, size_t n)
+{
+	if (out->len + n > OUT_SIZE) {
+		out_flush(out);
+		while (out->sink && n > OUT_SIZE) {
+			memcpy(out->data, s, OUT_SIZE);
+			out->len = OUT_SIZE;
+			out_flush(out);
+			s = s + OUT_SIZE;
+			n = n - OUT_SIZE;
+		}
+		if (n > OUT_SIZE) {
+			write_all(out->fd, s, n);
+			return;
+		}
+	}
+	memcpy(out->data + out->len, s, n);
+	out->len = out->len + n;
+}
+
+void out_str(out_buf_t *out, const char *s)
+{
+	out_bytes(out, s, strlen(s));
+}
+
+void out_char(out_buf_t *out, char c)
+{
+	if (out->len == OUT_SIZE)
+		out_flush(out);
+	out->data[out->len++] = c;
+}
 
-#define DIE(assertion, call_description)					\
-do {														\
-	if (assertion) {										\
-		fprintf(stderr, "(%s, %d): ", __FILE__, __LINE__);	\
-		perror(call_description);							\
-		exit(errno);										\
-	}														\
-} while (0)
-
-typedef struct info {
-	int address;	// adresa de inceput al unui bloc de memorie
-	int dimension;	// dimensiune blocului de memorie
-	char *s;		// sirul de caractere retinut in blocul de memorie
-} info;
-
-typedef struct dll_node_t {
-	void *data;	// Pentru ca datele stocate sa poata avea orice tip
-	struct dll_node_t *prev, *next;
-} dll_node_t;
-
-typedef struct dl_list_t {
-	dll_node_t *head;
-	int data_size;
-	int size;
-} dl_list_t;
-
-typedef struct sfl {
-	int nr_lists;
-	int address;
-	int nr_bytes;
-	int type;
-	int *capacity;	// retine numerul de bytes al fiecarui bloc dintr-o lista
-	dl_list_t **memory;	// vectorul de liste
-} sfl;
+// adauga un numar in baza 10, ca "%d" / "%lld"
+void out_dec(out_buf_t *out, long long x)
+{
+	char digits[24];
+	int n = sizeof(digits);
+	unsigned long long v = x;
+	if (x < 0)
+		v = -v;
+	do {
+		digits[--n] = '0' + v % 10;
+		v = v / 10;
+	} while (v);
+	if (x < 0)
+		digits[--n] = '-';
+	out_bytes(out, digits + n, sizeof(digits) - n);
+}
+
+// adauga o adresa in baza 16, ca "0x%llx"
+void out_hex(out_buf_t *out, unsigned long long x)
+{
+	char digits[24];
+	int n = sizeof(digits);
+	do {
+		digits[--n] = "0123456789abcdef"[x & 15];
+		x = x >> 4;
+	} while (x);
+	digits[--n] = 'x';
+	digits[--n] = '0';
+	out_bytes(out, digits + n, sizeof(digits) - n);
+}
 
 // returneaza nodul dintr-o lista de la o anumita pozitie specificata
 dll_node_t *dll_get_nth_node(dl_list_t *list, int n)
@@ -52,18 +198,14 @@ dll_node_t *dll_get_nth_node(dl_list_t *list, int n)
 	return current;
 }
 
-// adauga un nou nod intr-o lista la o anumita pozitie
-void dll_add_nth_node(dl_list_t *list, int n, void *data)
+// adauga un nou nod intr-o lista la o anumita pozitie si il returneaza
+dll_node_t *dll_add_nth_node(dl_list_t *list, int n, info *data)
 {
 	// cream noul nod
-	dll_node_t *new_node = malloc(sizeof(*new_node));
-	DIE(!new_node, "malloc failed...");
-	new_node->data = malloc(list->data_size);
-	DIE(!new_node->data, "malloc failed...");
+	dll_node_t *new_node = pool_alloc(list->pool);
 	new_node->next = NULL;
 	new_node->prev = NULL;
-
-	memcpy(new_node->data, data, list->data_size);
+	new_node->data = *data;
 
 	if (list->size == 0) {	// daca lista e goala
 		list->head = new_node;
@@ -84,6 +226,7 @@ void dll_add_nth_node(dl_list_t *list, int n, void *data)
 		current->prev = new_node;
 	}
 	list->size++;
+	return new_node;
 }
 
 // sterge un nod dintr-o lista si il returneaza ca sa fie eliberat din memorie
@@ -112,688 +255,3241 @@ dll_node_t *ll_remove_nth_node(dl_list_t *list, int n)
 	} else {
 		prev->next = curr->next;
 	}
+	if (curr->next)
+		curr->next->prev = prev;
 
 	list->size--;
 	return curr;
 }
 
-// creaza o noua lista dublu inlantuita
-dl_list_t *dll_create(int data_size)
+// creaza o noua lista dublu inlantuita, cu nodurile luate din pool
+dl_list_t *dll_create(pool_t *pool)
 {
 	dl_list_t *list = malloc(sizeof(*list));
 	DIE(!list, "malloc failed...");
 	list->head = NULL;
-	list->data_size = data_size;
+	list->pool = pool;
 	list->size = 0;
+	list->lazy_address = 0;
+	list->lazy_count = 0;
+	list->index = NULL;
+	list->counted = 0;
+	list->offsets = NULL;
+	list->max_offsets = 0;
 	return list;
 }
 
-// functie care creaza vectorul de liste
-dl_list_t **create_list_vector(sfl *heap)
+// adauga un nou nod in lista dupa nodul prev (la inceput daca prev e NULL)
+dll_node_t *dll_add_after(dl_list_t *list, dll_node_t *prev, info *data)
 {
-	// alocam memorie pentru vectorul de liste
-	dl_list_t **memory = (dl_list_t **)malloc(heap->nr_lists * sizeof(*memory));
-	DIE(!memory, "malloc failed...");
-
-	heap->capacity = (int *)malloc(heap->nr_lists * sizeof(int));
-	DIE(!heap->capacity, "malloc failed...");
+	dll_node_t *new_node = pool_alloc(list->pool);
+	new_node->data = *data;
 
-	int i, j, dim = 8, nr_blocks;
-	nr_blocks = heap->nr_bytes / dim;	// numarul de noduri
-	int adrr = heap->address;	// adresa de inceput a primei liste
-	for (i = 0; i < heap->nr_lists; i++) {
-		memory[i] = dll_create(sizeof(info));	// cream pe rand listele
-		heap->capacity[i] = dim;	// actualizam numarul de bytes din blocuri
-		for (j = 0; j < nr_blocks; j++) {
-			// adaugam in fiecare lista noduri cu datele specifice
-			info *node = malloc(sizeof(info));
-			node->address = adrr;
-			node->dimension = dim;
-			node->s = NULL;
-			dll_add_nth_node(memory[i], j, (void *)node);
-			free(node);
-			adrr = adrr + dim;
-		}
-		dim = dim * 2;
-		nr_blocks = nr_blocks / 2;
+	new_node->prev = prev;
+	if (prev) {
+		new_node->next = prev->next;
+		prev->next = new_node;
+	} else {
+		new_node->next = list->head;
+		list->head = new_node;
 	}
-	return memory;
+	if (new_node->next)
+		new_node->next->prev = new_node;
+	list->size++;
+	return new_node;
 }
 
-// functie care calculeaza numarul de bytes alocati
-int allocated_memory(dl_list_t *list)
+// scoate din lista un nod cunoscut si il returneaza ca sa fie eliberat
+dll_node_t *dll_remove_node(dl_list_t *list, dll_node_t *node)
 {
-	int nr = 0;
-	dll_node_t *current = list->head;
-	while (current) {
-		nr = nr + ((info *)current->data)->dimension;
-		current = current->next;
+	if (node->prev)
+		node->prev->next = node->next;
+	else
+		list->head = node->next;
+	if (node->next)
+		node->next->prev = node->prev;
+	list->size--;
+	return node;
+}
+
+// prioritatea pseudo-aleatoare a unei chei din treap
+static unsigned int tree_priority(sfl_addr_t key)
+{
+	unsigned int x = (unsigned int)(key ^ (key >> 32));
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// recalculeaza cel mai mare bloc din subarborele lui t, dupa fiii lui
+static void tree_update(tree_node_t *t)
+{
+	sfl_addr_t max = t->node->data.dimension;
+	if (t->left && t->left->max_dimension > max)
+		max = t->left->max_dimension;
+	if (t->right && t->right->max_dimension > max)
+		max = t->right->max_dimension;
+	t->max_dimension = max;
+}
+
+/*
+	Imparte arborele root in doua: left cu cheile mai mici decat key si right
+	cu cheile mai mari sau egale cu key.
+*/
+void tree_split(tree_node_t *root, sfl_addr_t key, tree_node_t **left,
+				tree_node_t **right)
+{
+	if (!root) {
+		*left = NULL;
+		*right = NULL;
+	} else if (root->key < key) {
+		tree_split(root->right, key, &root->right, right);
+		tree_update(root);
+		*left = root;
+	} else {
+		tree_split(root->left, key, left, &root->left);
+		tree_update(root);
+		*right = root;
 	}
-	return nr;
 }
 
-// functie care calculeaza numarul de blocuri din vectorul de liste
-int blocks_number(dl_list_t **memory, int nr_lists)
+// uneste doi arbori, toate cheile din left fiind mai mici decat cele din right
+tree_node_t *tree_merge(tree_node_t *left, tree_node_t *right)
 {
-	int i, nr = 0;
-	for (i = 0; i < nr_lists; i++)
-		nr = nr + memory[i]->size;
-	return nr;
+	if (!left)
+		return right;
+	if (!right)
+		return left;
+	if (left->priority > right->priority) {
+		left->right = tree_merge(left->right, right);
+		tree_update(left);
+		return left;
+	}
+	right->left = tree_merge(left, right->left);
+	tree_update(right);
+	return right;
 }
 
-// afisam datele din structurile de date
-void dump_memory_print(sfl *heap, dl_list_t *mem_alloc)
+// adauga in arbore cheia key, asociata nodului node din lista
+void tree_insert(pool_t *pool, tree_node_t **root, sfl_addr_t key,
+				 dll_node_t *node)
 {
-	// afisam pentru fiecare lista datele acesteia
-	for (int i = 0; i < heap->nr_lists; i++) {
-		if (heap->memory[i]->size != 0) {
-			printf("Blocks with %d bytes - %d free block(s) :",
-				   heap->capacity[i], heap->memory[i]->size);
-			dll_node_t *current = heap->memory[i]->head;
-			for (int j = 0; j < heap->memory[i]->size ; j++) {
-				printf(" 0x%x", ((info *)current->data)->address);
-				current = current->next;
-			}
-			printf("\n");
-		}
+	tree_node_t *new_node = pool_alloc(pool);
+	new_node->key = key;
+	new_node->priority = tree_priority(key);
+	new_node->node = node;
+	new_node->left = NULL;
+	new_node->right = NULL;
+
+	/*
+		coboram pana la pozitia data de prioritate, apoi impartim subarborele;
+		noul bloc ajunge in subarborii tuturor nodurilor de pe drum
+	*/
+	sfl_addr_t dimension = node->data.dimension;
+	while (*root && (*root)->priority > new_node->priority) {
+		if ((*root)->max_dimension < dimension)
+			(*root)->max_dimension = dimension;
+		root = key < (*root)->key ? &(*root)->left : &(*root)->right;
 	}
+	tree_split(*root, key, &new_node->left, &new_node->right);
+	tree_update(new_node);
+	*root = new_node;
+}
 
-	// afisam datele din lista de blocuri alocate
-	printf("Allocated blocks :");
-	if (mem_alloc->size != 0) {
-		dll_node_t *curr = mem_alloc->head;
-		while (curr) {
-			printf(" (0x%x - %d)", ((info *)curr->data)->address,
-				   ((info *)curr->data)->dimension);
-			curr = curr->next;
-		}
+// sterge din arbore cheia key, daca exista
+void tree_erase(pool_t *pool, tree_node_t **root, sfl_addr_t key)
+{
+	tree_node_t *t = *root;
+	if (!t)
+		return;
+	if (t->key == key) {
+		*root = tree_merge(t->left, t->right);
+		pool_free(pool, t);
+		return;
 	}
-	printf("\n");
-	printf("-----DUMP-----\n");
+	tree_erase(pool, key < t->key ? &t->left : &t->right, key);
+	tree_update(t);
 }
 
-// functie pentru comanda dump
-void dump_print(sfl *heap, dl_list_t *mem_alloc, long long total_memory,
-				int malloc_calls, int nr_fragmentation, int free_calls)
+// returneaza nodul din arbore cu cheia key sau NULL
+tree_node_t *tree_find(tree_node_t *root, sfl_addr_t key)
 {
-	// afisam datele cerute
-	printf("+++++DUMP+++++\n");
-	printf("Total memory: %lld bytes\n", total_memory);
-	int alloc_memory = allocated_memory(mem_alloc);
-	printf("Total allocated memory: %d bytes\n", alloc_memory);
-	printf("Total free memory: %lld bytes\n", total_memory - alloc_memory);
-	printf("Free blocks: %d\n", blocks_number(heap->memory, heap->nr_lists));
-	printf("Number of allocated blocks: %d\n", mem_alloc->size);
-	printf("Number of malloc calls: %d\n", malloc_calls);
-	printf("Number of fragmentations: %d\n", nr_fragmentation);
-	printf("Number of free calls: %d\n", free_calls);
-	dump_memory_print(heap, mem_alloc);
+	while (root && root->key != key)
+		root = key < root->key ? root->left : root->right;
+	return root;
 }
 
-/*
-	Functie care cauta in vectorul de liste un bloc de memorie pentru comanda
-	malloc si returneaza acel bloc din lista de index pos din vectorul de liste
-	sau NULL in caz ca nu s-a gasit un bloc de memorie. Se va schimba si
-	valoarea parametrului frag, in caz ca blocul se va fragmenta.
-*/
-dll_node_t *find_block(dl_list_t **memory, int nr_bytes, int nr_lists,
-					   int *frag, int *pos, int *v)
-{
-	// cautam la nivel de vector, o lista de blocuri cu dimensiunea potrivita
-	int i, found = 0, dim, position;
-	dll_node_t *current;
-	for (i = 0; i < nr_lists; i++) {
-		dim = v[i];	// dimensiunea unui bloc din lista i
-		if (nr_bytes > dim) {
-			continue;
+// returneaza nodul din arbore cu cea mai mare cheie <= key sau NULL
+tree_node_t *tree_floor(tree_node_t *root, sfl_addr_t key)
+{
+	tree_node_t *best = NULL;
+	while (root) {
+		if (root->key <= key) {
+			best = root;
+			root = root->right;
 		} else {
-			// parcurgem lista sa gasim nodul
-			current = memory[i]->head;
-			if (current) {
-				found = 1;	// am gasit un nod
-				position = i;
-				break;
-			}
-
-			if (found == 0) {	// nu am gasit un block de memorie in lista
-				// continuam cautarea in vector
-				continue;
-			}
+			root = root->left;
 		}
 	}
-	if (found == 0)
-		return NULL;
-
-	if (dim != nr_bytes)
-		*frag = 1;
-		// else, frag ramane 0, deci nu se fragmeneaza
-
-	*pos = position;
-	return current;
+	return best;
 }
 
 /*
-	returneaza pozitia dintr-o lista cu adrese crescatoare, unde sa se
-	introduca un nod cu o noua adresa
+	Returneaza nodul cu cea mai mica cheie >= key al carui bloc are cel putin
+	size octeti, sau NULL. Subarborii fara un bloc destul de mare se sar.
+	Nodurile vizitate se aduna in steps.
 */
-int position_index(dl_list_t *list, int address)
+tree_node_t *tree_ceil_fit(tree_node_t *root, sfl_addr_t key,
+						   sfl_addr_t size, long long *steps)
 {
-	dll_node_t *current = list->head;
-	int index = 0;
-	while (current && ((info *)current->data)->address < address) {
-		current = current->next;
-		index++;
-	}
-	return index;
+	if (!root || root->max_dimension < size)
+		return NULL;
+	*steps = *steps + 1;
+	if (root->key < key)
+		return tree_ceil_fit(root->right, key, size, steps);
+	tree_node_t *found = tree_ceil_fit(root->left, key, size, steps);
+	if (found)
+		return found;
+	if (root->node->data.dimension >= size)
+		return root;
+	return tree_ceil_fit(root->right, key, size, steps);
 }
 
 /*
-	verifica daca exista o lista de dimensiune dimension in sfl si o
-	returneaza in caz ca o gaseste, altfel returneaza NULL
+	Best-fit in arborele de adrese: nodul cu cel mai mic bloc de cel putin
+	size octeti, iar dintre blocurile egale cel cu adresa cea mai mica, in
+	*best. Subarborii fara un bloc destul de mare se sar, iar cautarea se
+	opreste la primul bloc exact cat cererea. Nodurile vizitate se aduna in
+	steps.
 */
-dl_list_t *exist_list(sfl *heap, int dimension)
+static void tree_best_fit(tree_node_t *root, sfl_addr_t size,
+						  tree_node_t **best, long long *steps)
 {
-	int i, dim_list;
-	for (i = 0; i < heap->nr_lists; i++) {
-		dim_list = heap->capacity[i];
-		if (dimension == dim_list)
-			return heap->memory[i];
-	}
-	return NULL;
-}
-
-/*
-	Adauga o noua lista cu blocuri de o noua dimensiune iar aopi se ordoneaza
-	tot vectorul de liste dupa dimensiunea unui bloc. Se va ordona in acelasi
-	timp si vectorul care retine dimensiunea blocurilor.
-*/
-void add_new_list(sfl *heap, int new_addr, int new_dim)
-{
-	int i, j;
-	heap->memory[heap->nr_lists - 1] = dll_create(sizeof(info));
-	heap->capacity[heap->nr_lists - 1] = new_dim;
-	// se adauga blocul cu noile date
-	info *node = malloc(sizeof(info));
-	DIE(!node, "malloc failed...");
-	node->address = new_addr;
-	node->dimension = new_dim;
-	node->s = NULL;
-	dll_add_nth_node(heap->memory[heap->nr_lists - 1], 0, (void *)node);
-	free(node);
-
-	// se face sortarea crescatoare
-	for (i = 0; i < heap->nr_lists - 1; i++) {
-		for (j = i + 1; j < heap->nr_lists; j++) {
-			if (heap->capacity[i] > heap->capacity[j]) {
-				dl_list_t *aux;
-				aux = heap->memory[i];
-				heap->memory[i] = heap->memory[j];
-				heap->memory[j] = aux;
-
-				int copy;
-				copy = heap->capacity[i];
-				heap->capacity[i] = heap->capacity[j];
-				heap->capacity[j] = copy;
-			}
-		}
-	}
+	if (!root || root->max_dimension < size ||
+		(*best && (*best)->node->data.dimension == size))
+		return;
+	*steps = *steps + 1;
+	tree_best_fit(root->left, size, best, steps);
+	sfl_addr_t dimension = root->node->data.dimension;
+	if (dimension >= size &&
+		(!*best || dimension < (*best)->node->data.dimension))
+		*best = root;
+	tree_best_fit(root->right, size, best, steps);
 }
 
-// functia pentru comanda malloc
-void malloc_command(sfl *heap, dl_list_t *mem_alloc, int *malloc_calls,
-					int *nr_fragmentation)
+// numarul de blocuri libere dintr-o lista, cu tot cu cele fara noduri
+sfl_addr_t list_blocks(dl_list_t *list)
 {
-	int frag = 0;	// presupunem ca nu se fragmenteaza
-	int index = 0;
+	return list->size + list->lazy_count;
+}
 
-	// cautam in vectorul de liste un bloc de memorie de dimensiunea nr_bytes
-	dll_node_t *mem_block = find_block(heap->memory, heap->nr_bytes,
-										heap->nr_lists, &frag, &index,
-										heap->capacity);
-	if (!mem_block) {
-		// daca nu am gasit niciun bloc se va afisa mesajul semnificativ
-		printf("Out of memory\n");
-	} else {
-		// am gasit un bloc de memorie
-		*malloc_calls = *malloc_calls + 1;	// numarul de apeluri malloc
-
-		// calculam noile dimensiuni
-		int new_dim = heap->capacity[index] - heap->nr_bytes;
-		int addr = ((info *)mem_block->data)->address;
-		int new_adr = ((info *)mem_block->data)->address + heap->nr_bytes;
-
-		// stergem nodul din lista respectiva si eliberam memoria
-		dll_node_t *node = ll_remove_nth_node(heap->memory[index], 0);
-		if (((info *)node->data)->s)	// daca s-a alocat un sir
-			free(((info *)node->data)->s);
-		free(node->data);
-		free(node);
-
-		// cream noul nod pe care il adaugam in lista cu blocuri alocate
-		info *new_node = malloc(sizeof(info));
-		new_node->address = addr;
-		new_node->dimension = heap->nr_bytes;
-		new_node->s = NULL;
-		int position = position_index(mem_alloc, addr);
-		dll_add_nth_node(mem_alloc, position, (void *)new_node);
-		free(new_node);
-
-		if (frag == 1) {	// daca s-a fragmentat nodul
-			*nr_fragmentation = *nr_fragmentation + 1;
-			dl_list_t *list = exist_list(heap, new_dim);// cautam o lista
-			if (list) {
-				// exista o lista in care se poate adauga blocul ramas
-				int pos = position_index(list, new_adr);
-				info *another_node = malloc(sizeof(info));
-				another_node->address = new_adr;
-				another_node->dimension = new_dim;
-				another_node->s = NULL;
-				dll_add_nth_node(list, pos, (void *)another_node);
-				free(another_node);
-			} else {
-				// se da realloc
-				heap->nr_lists++;
-				heap->memory = realloc(heap->memory,
-									   heap->nr_lists * sizeof(dl_list_t *));
-				DIE(!heap->memory, "malloc failed...");
-				heap->capacity = realloc(heap->capacity,
-										 heap->nr_lists * sizeof(int));
-				// inseram o lista;
-				add_new_list(heap, new_adr, new_dim);
-			}
-		}
+// adresa blocului k din vectorul de distante al unei liste libere
+static sfl_addr_t offset_address(sfl *heap, dl_list_t *list, int k)
+{
+	return heap->regions[0] + (sfl_addr_t)list->offsets[k];
+}
+
+// clasa TLSF (primul si al doilea nivel) a blocurilor de size octeti
+static void tlsf_mapping(unsigned long long size, int *fl, int *sl)
+{
+	if (size < TLSF_SL) {
+		*fl = 0;
+		*sl = size;
+		return;
 	}
+	int log = 63 - __builtin_clzll(size);
+	*fl = log - TLSF_SL_LOG + 1;
+	*sl = (size >> (log - TLSF_SL_LOG)) - TLSF_SL;
+}
+
+// cea mai mica dimensiune din clasa TLSF (fl, sl)
+static unsigned long long tlsf_class_start(int fl, int sl)
+{
+	if (fl == 0)
+		return sl;
+	return (unsigned long long)(TLSF_SL + sl) << (fl - 1);
 }
 
 /*
-	returneaza blocul de memorie care are adresa addr din lista suplimentara
-	si actualizeaza pozitia acestuia
+	Numara o lista in clasa TLSF a dimensiunii ei cand primeste blocuri si o
+	scoate cand ramane goala; bitii claselor nevide se actualizeaza odata cu
+	numarul de liste al clasei.
 */
-dll_node_t *find_address(dl_list_t *mem_alloc, int addr, int *pos)
+static void tlsf_update(sfl *heap, sfl_addr_t capacity, int nonempty)
 {
-	dll_node_t *current = mem_alloc->head;
-	int position = 0;
-	while (current) {
-		if (((info *)current->data)->address == addr) {
-			*pos = position;
-			return current;
-		}
-		current = current->next;
-		position++;
-	}
-	return NULL;
-}
-
-// functie pentru comanda free
-void free_command(sfl *heap, dl_list_t *mem_alloc, int *free_calls)
-{
-	int pos = 0;
-	dll_node_t *n_free = find_address(mem_alloc, heap->address, &pos);
-	if (n_free) {	// daca s-a gasit un bloc de adresa address
-		*free_calls = *free_calls + 1;	// marim numarul de comenzi free
-		dl_list_t *list = exist_list(heap, ((info *)n_free->data)->dimension);
-		if (list) {
-			// exista o lista in care se poate adauga blocul ramas
-			int index = position_index(list, heap->address);
-			// se creaza noul nod pe care il adaugam in lista de vectori
-			info *another_node = malloc(sizeof(info));
-			another_node->address = ((info *)n_free->data)->address;
-			another_node->dimension = ((info *)n_free->data)->dimension;
-			another_node->s = NULL;
-			dll_add_nth_node(list, index, (void *)another_node);
-			free(another_node);
-		} else {
-			// se da realloc
-			heap->nr_lists++;
-			heap->memory = realloc(heap->memory,
-								   heap->nr_lists * sizeof(dl_list_t *));
-			DIE(!heap->memory, "malloc failed...");
-			heap->capacity = realloc(heap->capacity,
-									 heap->nr_lists * sizeof(int));
-			// inseram o lista
-			add_new_list(heap, ((info *)n_free->data)->address,
-						 ((info *)n_free->data)->dimension);
-		}
-		// stergem nodul din lista de blocuri de memorie alocata
-		dll_node_t *free_block = ll_remove_nth_node(mem_alloc, pos);
-		if (((info *)free_block->data)->s)	// daca s-a aocat un sir
-			free(((info *)free_block->data)->s);
-		free(free_block->data);
-		free(free_block);
-	} else {
-		// daca nu s-a gasit un bloc de memorie se afiseaza un mesaj specific
-		printf("Invalid free\n");
+	int fl, sl;
+	tlsf_mapping(capacity, &fl, &sl);
+	int *count = &heap->tlsf_count[fl][sl];
+	if (nonempty && (*count)++ == 0) {
+		heap->tlsf_second[fl] |= 1U << sl;
+		heap->tlsf_first |= 1ULL << fl;
+	} else if (!nonempty && --(*count) == 0) {
+		heap->tlsf_second[fl] &= ~(1U << sl);
+		if (!heap->tlsf_second[fl])
+			heap->tlsf_first &= ~(1ULL << fl);
 	}
 }
 
-// fuctie care elibereaza memoria pentru o lista
-void ll_free(dl_list_t **list)
+// clasa unei dimensiuni sau lungimi pentru statistici: partea intreaga din log2
+static int stats_class(unsigned long long x)
 {
-	dll_node_t *curr;
+	int k = x ? 63 - __builtin_clzll(x) : 0;
+	return k < STATS_CLASSES ? k : STATS_CLASSES - 1;
+}
 
-	if (!list || !*list)
+/*
+	Marcheaza in bitmap daca lista de pe pozitia i are sau nu blocuri libere.
+	Toate schimbarile listelor libere trec pe aici, asa ca tot aici se
+	actualizeaza clasele TLSF si statisticile blocurilor libere, dupa cate
+	blocuri avea lista la ultimul apel.
+*/
+void mark_list(sfl *heap, int i)
+{
+	dl_list_t *list = heap->memory[i];
+	sfl_addr_t blocks = list_blocks(list), old = list->counted;
+	unsigned long long bit = 1ULL << (i % WORD_BITS);
+	if (blocks != 0)
+		heap->nonempty[i / WORD_BITS] |= bit;
+	else
+		heap->nonempty[i / WORD_BITS] &= ~bit;
+	if (blocks == old)
 		return;
 
-	while ((*list)->size > 0) {
-		// stergem si eliberam noduri rand pe rand
-		curr = ll_remove_nth_node(*list, 0);
-		if (curr) {
-			if (((info *)curr->data)->s)
-				free(((info *)curr->data)->s);
-			free(curr->data);
+	if (heap->policy == POLICY_TLSF && !blocks != !old)
+		tlsf_update(heap, heap->capacity[i], blocks != 0);
+	sfl_stats_t *stats = &heap->stats;
+	stats->free_blocks = stats->free_blocks + blocks - old;
+	stats->free_bytes = stats->free_bytes + (blocks - old) * heap->capacity[i];
+	if (old)
+		stats->list_lengths[stats_class(old)]--;
+	if (blocks)
+		stats->list_lengths[stats_class(blocks)]++;
+	list->counted = blocks;
+}
+
+/*
+	Adauga o schimbare in jurnalul lui DUMP_DELTA, daca jurnalul e pornit.
+	Cand jurnalul ar trebui sa creasca peste dublul blocurilor din heap, un
+	dump complet ar fi mai scurt decat diferenta, asa ca jurnalul se opreste
+	si urmatorul DUMP_DELTA afiseaza tot heap-ul.
+*/
+static void log_change(sfl *heap, int allocated, sfl_addr_t address,
+					   sfl_addr_t dimension, int sign)
+{
+	if (!heap->logging)
+		return;
+	if (heap->nr_changes == heap->max_changes) {
+		long long blocks = heap->stats.free_blocks +
+						   heap->stats.free_extents +
+						   heap->stats.allocated_blocks;
+		long long max = heap->max_changes ? 2 * heap->max_changes
+										  : MIN_CHANGES;
+		if (max > MIN_CHANGES && max > 2 * blocks) {
+			heap->logging = 0;
+			heap->nr_changes = 0;
+			return;
 		}
-		free(curr);
+		heap->changes = realloc(heap->changes, max * sizeof(change_t));
+		DIE(!heap->changes, "realloc failed...");
+		heap->max_changes = max;
 	}
-
-	free(*list);
-	*list = NULL;
+	change_t *change = &heap->changes[heap->nr_changes++];
+	change->address = address;
+	change->dimension = dimension;
+	change->allocated = allocated;
+	change->sign = sign;
 }
 
 /*
-	Functie care citeste parametrii comenzii write si returneaza sirul de
-	caractere citit. Parametrul nr va actualiza numarul citit dupa sirul de
-	caractere, iar al doilea parametru se va folosi pentru eliberarea memoriei
-	pentru sirul de caractere.
+	Realoca vectorul de liste, vectorul de dimensiuni si bitmap-ul pentru
+	max_lists pozitii. Pozitiile noi din vectorul de liste raman NULL.
 */
-char *scan_string(int *nr, char **p)
+void resize_list_vector(sfl *heap, int max_lists)
 {
-	char *s = (char *)malloc(600 * sizeof(char));
-	fgets(s, 600, stdin);	// se citeste restul liniei
-	int start = -1, stop;	// unde incepe si unde se sfarseste sirul
-	s[strlen(s) - 1] = '\0';
-	for (unsigned int i = 0; i < strlen(s); i++) {
-		if (s[i] == '"' && start == -1)
-			start = i;
-		else if (s[i] == '"')
-			stop = i;
-	}
-	// actualizam numarul de caractere care se vor scrie
-	*nr = atoi(s + stop + 1);
-	s[stop + 1] = '\0';
-	*p = s;	// inceputul sirului, pentru a elibera ulterior memoria
-	return s + start;
+	heap->memory = realloc(heap->memory, max_lists * sizeof(dl_list_t *));
+	DIE(!heap->memory, "realloc failed...");
+	heap->capacity = realloc(heap->capacity,
+							 max_lists * sizeof(*heap->capacity));
+	DIE(!heap->capacity, "realloc failed...");
+	for (int i = heap->max_lists; i < max_lists; i++)
+		heap->memory[i] = NULL;
+
+	// un cuvant in plus, ca deplasarea din insert_bit sa nu iasa din vector
+	int old_words = heap->nonempty ? heap->max_lists / WORD_BITS + 1 : 0;
+	int words = max_lists / WORD_BITS + 1;
+	heap->nonempty = realloc(heap->nonempty, words * sizeof(*heap->nonempty));
+	DIE(!heap->nonempty, "realloc failed...");
+	memset(heap->nonempty + old_words, 0,
+		   (words - old_words) * sizeof(*heap->nonempty));
+	heap->max_lists = max_lists;
+}
+
+// reface bitmap-ul cu listele nevide dupa ce s-au mutat listele in vector
+void rebuild_bitmap(sfl *heap)
+{
+	int words = heap->max_lists / WORD_BITS + 1;
+	memset(heap->nonempty, 0, words * sizeof(*heap->nonempty));
+	for (int i = 0; i < heap->nr_lists; i++)
+		mark_list(heap, i);
 }
 
 /*
-	returneaza primul bloc de memorie din lista de blocri alocate care incepe
-	sau contine adresa data ca parametru si verifica in acelasi timp daca
-	exista o zona de memorie continua se nr_bytes octeti
+	Deplaseaza cu o pozitie la dreapta bitii de la pozitia pos incolo, pentru
+	a face loc unei liste noi inserate pe pozitia pos. Bitul pos ramane 0.
 */
-dll_node_t *continuos_area(dl_list_t *mem_alloc, int nr_bytes, int address)
+void insert_bit(sfl *heap, int pos)
 {
-	dll_node_t *current = mem_alloc->head;
-	while (current) {
-		if (((info *)current->data)->address <= address &&
-			address <= ((info *)current->data)->address +
-			((info *)current->data)->dimension) {
-			// am gasit blocul de memorie
+	unsigned long long *bits = heap->nonempty;
+	int w = pos / WORD_BITS;
+	for (int i = heap->nr_lists / WORD_BITS; i > w; i--)
+		bits[i] = (bits[i] << 1) | (bits[i - 1] >> (WORD_BITS - 1));
 
-			// adresa ultimului octet din bloc
-			int x = ((info *)current->data)->address +
-					((info *)current->data)->dimension - 1;
+	unsigned long long low = (1ULL << (pos % WORD_BITS)) - 1;
+	bits[w] = (bits[w] & low) | ((bits[w] & ~low) << 1);
+}
 
-			dll_node_t *copy = current;
-			// sa verific daca e continua memoria
-			if (address + nr_bytes - 1 <= x)	// daca e suficient primul bloc
-				return copy;
+/*
+	Pregateste vectorul pentru nr_lists liste, cele nr_regions zone initiale,
+	arborii goi, lista goala a blocurilor alocate si zonele de noduri;
+	listele libere le creeaza INIT_HEAP sau LOAD_SNAPSHOT.
+*/
+static void heap_init(sfl *heap)
+{
+	// alocam memorie pentru vectorul de liste
+	heap->memory = NULL;
+	heap->capacity = NULL;
+	heap->nonempty = NULL;
+	heap->max_lists = 0;
+	resize_list_vector(heap, heap->nr_lists ? heap->nr_lists : 1);
+
+	// retinem zonele listelor initiale, pentru reconstituirea blocurilor
+	heap->regions = malloc((heap->nr_regions + 1) * sizeof(*heap->regions));
+	DIE(!heap->regions, "malloc failed...");
+	heap->free_index = NULL;
+	// modul buddy ia mereu cea mai mica clasa nevida care ajunge
+	heap->buddy = heap->type == 2;
+	if (heap->buddy)
+		heap->policy = POLICY_BEST;
+	heap->indexed = heap->type == 1 || heap->policy == POLICY_FIRST ||
+					heap->policy == POLICY_NEXT;
+	heap->rover = heap->address;
+	heap->next_block = 0;
+	heap->tlsf_first = 0;
+	memset(heap->tlsf_second, 0, sizeof(heap->tlsf_second));
+	memset(heap->tlsf_count, 0, sizeof(heap->tlsf_count));
+	memset(&heap->stats, 0, sizeof(heap->stats));
+	pool_init(&heap->nodes, sizeof(dll_node_t));
+	pool_init(&heap->tree_nodes, sizeof(tree_node_t));
+	heap->runs = dll_create(&heap->nodes);
+	heap->mem_alloc = dll_create(&heap->nodes);
+	heap->huge_threshold = 0;
+	heap->extents = dll_create(&heap->nodes);
+	heap->logging = 0;
+	heap->changes = NULL;
+	heap->nr_changes = 0;
+	heap->max_changes = 0;
+}
 
-			// ne uitam la alte blocuri
-			int total = nr_bytes - (x - address + 1);	// cati bytes ne raman
-			while (total > 0) {
-				if (current->next) {
-					if (((info *)current->next->data)->address == x + 1) {
-						current = current->next;
-						// adresa ultimului octet din bloc
-						x = ((info *)current->data)->address +
-							((info *)current->data)->dimension - 1;
-						total = total - ((info *)current->data)->dimension;
-					} else {
-						// nu e o zona continua de memorie
-						break;
-					}
-				} else {
-					// nu exista suficiente blocuri
-					break;
-				}
-			}
-			if (total <= 0) {
-				// e bine, e o zona de memorie continua
-				return copy;
-			}
+// listele libere tin distante daca nu exista arbore si distantele incap
+static void heap_set_compact(sfl *heap)
+{
+	sfl_addr_t size = heap->regions[heap->nr_regions] - heap->regions[0];
+	heap->compact = !heap->indexed && !heap->buddy &&
+					(unsigned long long)size <= (sfl_offset_t)-1;
+}
 
-			// nu s-a gasit o zona buna de memorie
-			return NULL;
-		}
-		current = current->next;
+/*
+	Rezervam o singura zona de size octeti pentru continutul tuturor
+	blocurilor, in locul celei vechi. Paginile ei primesc memorie fizica doar
+	cand se scrie in ele.
+*/
+static void arena_map(sfl *heap, size_t size)
+{
+	if (heap->arena)
+		munmap(heap->arena, heap->arena_size);
+	heap->arena_size = size;
+	heap->arena = NULL;
+	if (heap->arena_size) {
+		heap->arena = mmap(NULL, heap->arena_size, PROT_READ | PROT_WRITE,
+						   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		DIE(heap->arena == MAP_FAILED, "mmap failed...");
 	}
-	// daca nu s-a gasit nimic
-	return NULL;
 }
 
-// functie care va scrie in nodurile din lista de blocuri alocate un sir
-void write_in_memory(dl_list_t *mem_alloc, char *string, int n, int address)
+// functie care creaza vectorul de liste
+dl_list_t **create_list_vector(sfl *heap)
 {
-	dll_node_t *curr = mem_alloc->head;
-	while (curr) {
-		if (((info *)curr->data)->address <= address &&
-			address <= ((info *)curr->data)->address +
-			((info *)curr->data)->dimension - 1) {
-			// daca am gasit un nod bun
-
-			// adresa ultimului octet din bloc
-			int x = ((info *)curr->data)->address +
-					((info *)curr->data)->dimension - 1;
+	heap->nr_regions = heap->nr_lists;
+	heap_init(heap);
+	dl_list_t **memory = heap->memory;
+	int i;
+	sfl_addr_t dim = 8, nr_blocks;
+	nr_blocks = heap->nr_bytes / dim;	// numarul de blocuri
+	sfl_addr_t adrr = heap->address;	// adresa de inceput a primei liste
+	for (i = 0; i < heap->nr_lists; i++) {
+		memory[i] = dll_create(&heap->nodes);	// cream pe rand listele
+		heap->capacity[i] = dim;	// actualizam numarul de bytes din blocuri
+		heap->regions[i] = adrr;
+		// blocurile listei sunt consecutive, nodurile se creeaza la nevoie
+		memory[i]->lazy_address = adrr;
+		memory[i]->lazy_count = nr_blocks;
+		adrr = adrr + nr_blocks * dim;
+		dim = dim * 2;
+		nr_blocks = nr_blocks / 2;
+	}
+	heap->regions[heap->nr_lists] = adrr;
+	heap->huge_start = adrr;
+	heap->huge_end = adrr;
+	heap_set_compact(heap);
+	rebuild_bitmap(heap);
+	heap->arena = NULL;
+	arena_map(heap, adrr - heap->address);
+	return memory;
+}
 
-			if (n <= x - address + 1) {	// este suficient primul bloc
-				if (!((info *)curr->data)->s) {	// nu s-a alocat nimic
-					// alocam memorie pentru sir
-					int dim = ((info *)curr->data)->dimension;
-					((info *)curr->data)->s = malloc(dim + 1);
-					DIE(!((info *)curr->data)->s, "malloc failed...");
-				}
-				// copiem continutul sirului in nod
-				memcpy(((info *)curr->data)->s, string, n);
-				return;
-			}
+// INIT_HEAP: un heap nou, cu listele lui si fara blocuri alocate
+sfl *sfl_init(sfl_addr_t address, int nr_lists, sfl_addr_t nr_bytes,
+			  int type, int policy)
+{
+	sfl *heap = malloc(sizeof(sfl));
+	DIE(!heap, "malloc failed...");
+	heap->address = address;
+	heap->nr_lists = nr_lists;
+	heap->nr_bytes = nr_bytes;
+	heap->type = type;
+	heap->policy = policy;
+	heap->total_memory = (long long)nr_lists * nr_bytes;
+	heap->memory = create_list_vector(heap);
+	return heap;
+}
 
-			// scriem in mai multe noduri
-			if (!((info *)curr->data)->s) {	// nu s-a alocat nimic
-				// alocam memorie
-				int dim = ((info *)curr->data)->dimension;
-				((info *)curr->data)->s = malloc(dim + 1);
-				DIE(!((info *)curr->data)->s, "malloc failed...");
-			}
-			// copiem continutul sirului in nod
-			memcpy(((info *)curr->data)->s, string, x - address + 1);
+// copia statisticilor heap-ului
+void sfl_stats(sfl *heap, sfl_stats_t *stats)
+{
+	*stats = heap->stats;
+}
 
-			// ne uitam la alte blocuri
-			int total = n - (x - address + 1); // cat ne mai ramane de scris
-			curr = curr->next;
-			int index = x - address + 1;	// de unde copiem
-			while (total > 0) {
-				if (!((info *)curr->data)->s) {	// nu s-a alocat nimic
-					int dim = ((info *)curr->data)->dimension;
-					((info *)curr->data)->s = malloc(dim + 1);
-					DIE(!((info *)curr->data)->s, "malloc failed...");
-				}
-				if (total > ((info *)curr->data)->dimension) {
-					// mai ramand noduri in care copiem sirul
-					int dim = ((info *)curr->data)->dimension;
-					memcpy(((info *)curr->data)->s, string + index, dim);
-					index = index + dim;
+// afisam datele din structurile de date
+void dump_memory_print(out_buf_t *out, sfl *heap)
+{
+	dl_list_t *mem_alloc = heap->mem_alloc;
+	// afisam pentru fiecare lista datele acesteia
+	for (int i = 0; i < heap->nr_lists; i++) {
+		dl_list_t *list = heap->memory[i];
+		if (list_blocks(list) != 0) {
+			out_str(out, "Blocks with ");
+			out_dec(out, heap->capacity[i]);
+			out_str(out, " bytes - ");
+			out_dec(out, list_blocks(list));
+			out_str(out, " free block(s) :");
+			/*
+				interclasam blocurile cu adresa (noduri sau distante, cele
+				din urma luate de la sfarsit) cu blocurile fara noduri
+			*/
+			dll_node_t *current = list->head;
+			sfl_addr_t lazy = list->lazy_address, left = list->lazy_count;
+			sfl_addr_t address = 0;
+			int stored = list->size;
+			while (stored || left) {
+				out_char(out, ' ');
+				if (stored)
+					address = current ? current->data.address
+									  : offset_address(heap, list, stored - 1);
+				if (left && (!stored || lazy < address)) {
+					out_hex(out, lazy);
+					lazy = lazy + heap->capacity[i];
+					left--;
 				} else {
-					// ultimul nod in care copiem sirul
-					memcpy(((info *)curr->data)->s, string + index, total);
-					index = index + ((info *)curr->data)->dimension;
+					out_hex(out, address);
+					stored--;
+					if (current)
+						current = current->next;
 				}
-				total = total - ((info *)curr->data)->dimension;
-				curr = curr->next;
 			}
-			return;
+			out_char(out, '\n');
 		}
-		curr = curr->next;
 	}
-}
 
-// functie pentru comanda write
-void write_command(dl_list_t *mem_alloc, int address, int nr_bytes, char *str,
-				   int *dump)
-{
-	// calculam numarul de bytes care trebuie scrisi
-	int minim = nr_bytes;
-	if (nr_bytes > (int)strlen(str) - 2)
-		minim = strlen(str) - 2;
+	// extinderile libere ale zonei alocarilor mari
+	if (heap->extents->size != 0) {
+		out_str(out, "Free extents :");
+		for (dll_node_t *node = heap->extents->head; node; node = node->next) {
+			out_str(out, " (");
+			out_hex(out, node->data.address);
+			out_str(out, " - ");
+			out_dec(out, node->data.dimension);
+			out_char(out, ')');
+		}
+		out_char(out, '\n');
+	}
 
-	// verificam daca e o adresa continua de memorie
-	dll_node_t *it = continuos_area(mem_alloc, minim, address);
-	if (it) {
-		// vom scrie continutui in noduri
-		write_in_memory(mem_alloc, str + 1, minim, address);
-	} else {
-		// daca nu s-a gasit o zona continua afisam un mesaj si facem dump
-		printf("Segmentation fault (core dumped)\n");
-		*dump = 1;
+	// afisam datele din lista de blocuri alocate
+	out_str(out, "Allocated blocks :");
+	if (mem_alloc->size != 0) {
+		dll_node_t *curr = mem_alloc->head;
+		while (curr) {
+			out_str(out, " (");
+			out_hex(out, curr->data.address);
+			out_str(out, " - ");
+			out_dec(out, curr->data.dimension);
+			out_char(out, ')');
+			curr = curr->next;
+		}
 	}
+	out_char(out, '\n');
+	out_str(out, "-----DUMP-----\n");
 }
 
-// functie care va citi din nodurile din lista de blocuri alocate un sir
-void read_from_memory(dl_list_t *mem_alloc, int n, int address)
+// afiseaza o linie de forma "<text><valoare><sfarsit>"
+void dump_line(out_buf_t *out, const char *text, long long value,
+			   const char *end)
 {
-	dll_node_t *curr = mem_alloc->head;
-	while (curr) {
-		if (((info *)curr->data)->address <= address &&
-			address <= ((info *)curr->data)->address +
-			((info *)curr->data)->dimension - 1) {
-			// am gasit un nod
+	out_str(out, text);
+	out_dec(out, value);
+	out_str(out, end);
+}
 
-			// adresa ultimului octet din bloc
-			int x = ((info *)curr->data)->address +
-					((info *)curr->data)->dimension - 1;
+// suma contoarelor tuturor claselor
+static long long stats_total(long long *counts)
+{
+	long long total = 0;
+	for (int k = 0; k < STATS_CLASSES; k++)
+		total = total + counts[k];
+	return total;
+}
 
-			// pozitia de unde se va afisa sirul
-			int pos = address - ((info *)curr->data)->address;
-			if (n <= x - address + 1) {	// daca citim doar din primul nod
-				for (int i = pos; i < n + pos; i++)
-					printf("%c", ((info *)curr->data)->s[i]);
-				printf("\n");
-				return;
-			}
+/*
+	contoarele de la inceputul lui DUMP_MEMORY si DUMP_DELTA; numarul de
+	apeluri malloc (reusite), fragmentari, apeluri free si reuniri vin din
+	statisticile heap-ului, asa ca nu se parcurge nicio lista
+*/
+static void dump_counters(out_buf_t *out, sfl *heap)
+{
+	sfl_stats_t *stats = &heap->stats;
+	long long splits = stats_total(stats->splits);
+	dump_line(out, "Total memory: ", heap->total_memory, " bytes\n");
+	long long alloc_memory = stats->allocated_bytes;
+	dump_line(out, "Total allocated memory: ", alloc_memory, " bytes\n");
+	dump_line(out, "Total free memory: ", heap->total_memory - alloc_memory,
+			  " bytes\n");
+	dump_line(out, "Free blocks: ", stats->free_blocks, "\n");
+	dump_line(out, "Number of allocated blocks: ", heap->mem_alloc->size,
+			  "\n");
+	dump_line(out, "Number of malloc calls: ",
+			  stats_total(stats->hits) + splits, "\n");
+	dump_line(out, "Number of fragmentations: ", splits, "\n");
+	dump_line(out, "Number of free calls: ", stats->frees, "\n");
+	if (heap->type == 1 || heap->buddy)	// doar daca blocurile se reunesc
+		dump_line(out, "Number of merges: ", stats->merges, "\n");
+}
 
-			// ne uitam la alte blocuri
-			int dim = ((info *)curr->data)->dimension;
-			for (int i = pos; i < dim; i++)
-				printf("%c", ((info *)curr->data)->s[i]);
+// functie pentru comanda dump; DUMP_DELTA va afisa schimbarile de acum
+void dump_print(out_buf_t *out, sfl *heap)
+{
+	out_str(out, "+++++DUMP+++++\n");
+	dump_counters(out, heap);
+	dump_memory_print(out, heap);
+	heap->nr_changes = 0;
+}
 
-			// cat ne mai ramane de afisat
-			int total = n - (dim - pos);
-			curr = curr->next;
-			while (total > 0) {
-				if (total > ((info *)curr->data)->dimension) {
-					dim = ((info *)curr->data)->dimension;
-					for (int i = 0; i < dim; i++)
-						printf("%c", ((info *)curr->data)->s[i]);
-				} else {
-					// ultimul nod din care trebuie sa afisam
-					for (int i = 0; i < total; i++)
-						printf("%c", ((info *)curr->data)->s[i]);
-				}
-				total = total - ((info *)curr->data)->dimension;
-				curr = curr->next;
-			}
-			printf("\n");
-			return;
-		}
-		curr = curr->next;
-	}
+// ordoneaza schimbarile dupa lista, adresa si dimensiune
+static int compare_changes(const void *a, const void *b)
+{
+	const change_t *x = a, *y = b;
+	if (x->allocated != y->allocated)
+		return x->allocated - y->allocated;
+	if (x->address != y->address)
+		return x->address < y->address ? -1 : 1;
+	return (x->dimension > y->dimension) - (x->dimension < y->dimension);
 }
 
-// functie pentru comanda read
-void read_command(dl_list_t *mem_alloc, int nr_bytes, int address, int *dump)
+// o linie cu blocurile care au aparut (sign 1) sau au disparut (sign -1)
+static void delta_line(out_buf_t *out, const char *text, change_t *changes,
+					   long long n, int allocated, int sign)
 {
-	// verificam daca e o adresa continua de memorie
-	dll_node_t *read = continuos_area(mem_alloc, nr_bytes, address);
-	if (read) {
-		// afisam nr_bytes caractere din sir
-		read_from_memory(mem_alloc, nr_bytes, address);
-	} else {
-		// nu avem ce citi, se va afisa un mesaj si se va face dump
-		printf("Segmentation fault (core dumped)\n");
-		*dump = 1;
+	out_str(out, text);
+	for (long long i = 0; i < n; i++) {
+		if (changes[i].allocated != allocated || changes[i].sign != sign)
+			continue;
+		out_str(out, " (");
+		out_hex(out, changes[i].address);
+		out_str(out, " - ");
+		out_dec(out, changes[i].dimension);
+		out_char(out, ')');
 	}
+	out_char(out, '\n');
 }
 
-// functie care elibereaza memoria pentru structurile de date alocate
-void free_the_sfl(sfl *heap, dl_list_t *mem_alloc)
+/*
+	DUMP_DELTA: contoarele lui DUMP_MEMORY si blocurile libere si alocate
+	care s-au schimbat de la ultimul dump. Intrarile jurnalului pentru
+	acelasi bloc se anuleaza (alocat si eliberat intre doua dump-uri nu
+	apare), asa ca dupa ordonare fiecare bloc ramane cu suma semnelor lui.
+	Primul DUMP_DELTA, sau cel de dupa oprirea jurnalului, afiseaza tot
+	heap-ul, ca DUMP_MEMORY, si porneste jurnalul.
+*/
+void delta_print(out_buf_t *out, sfl *heap)
 {
-	for (int i = 0; i < heap->nr_lists; i++)
-		if (heap->memory[i])
-			ll_free(&heap->memory[i]);
+	if (!heap->logging) {
+		heap->logging = 1;
+		dump_print(out, heap);
+		return;
+	}
+	change_t *changes = heap->changes;
+	// changes e NULL pana la prima modificare inregistrata
+	if (heap->nr_changes)
+		qsort(changes, heap->nr_changes, sizeof(change_t), compare_changes);
+	long long n = 0;
+	for (long long i = 0, j; i < heap->nr_changes; i = j) {
+		int sign = 0;
+		for (j = i; j < heap->nr_changes &&
+			 compare_changes(&changes[i], &changes[j]) == 0; j++)
+			sign = sign + changes[j].sign;
+		if (sign) {
+			changes[n] = changes[i];
+			changes[n++].sign = sign;
+		}
+	}
 
-	free(heap->capacity);
-	free(heap->memory);
-	free(heap);
-	ll_free(&mem_alloc);
+	out_str(out, "+++++DELTA+++++\n");
+	dump_counters(out, heap);
+	delta_line(out, "Removed free blocks :", changes, n, 0, -1);
+	delta_line(out, "Added free blocks :", changes, n, 0, 1);
+	if (heap->huge_end != heap->huge_start) {
+		delta_line(out, "Removed free extents :", changes, n, 2, -1);
+		delta_line(out, "Added free extents :", changes, n, 2, 1);
+	}
+	delta_line(out, "Removed allocated blocks :", changes, n, 1, -1);
+	delta_line(out, "Added allocated blocks :", changes, n, 1, 1);
+	out_str(out, "-----DELTA-----\n");
+	heap->nr_changes = 0;
 }
 
-int main(void)
+static const char *command_names[CMD_TYPES] = {
+	"", "INIT_HEAP", "MALLOC", "FREE", "READ", "WRITE", "DUMP_MEMORY",
+	"DESTROY_HEAP", "MALLOC_N", "FREE_N", "STATS", "SAVE_SNAPSHOT",
+	"LOAD_SNAPSHOT", "DUMP_DELTA"
+};
+
+int stats_sample(command_stats_t *stats, int type)
 {
-	char *command = (char *)malloc(600 * sizeof(char));
-	scanf("%s", command);
+	return stats->commands[type]++ % STATS_SAMPLE == 0;
+}
 
-	sfl *heap = malloc(sizeof(sfl));
-	DIE(!heap, "malloc failed...");
-	dl_list_t *mem_alloc;	// lista dublu inlantuita cu blocuri alocate
-	long long total_memory;
-	int malloc_calls = 0, free_calls = 0, nr_fragmentation = 0, dump = 0;
+void stats_latency(command_stats_t *stats, int type, long long ns)
+{
+	if (ns < 0)
+		ns = 0;
+	if (ns > 0xffffffffLL)
+		ns = 0xffffffffLL;
+	int fl, sl;
+	tlsf_mapping(ns, &fl, &sl);
+	stats->latency[type][fl * TLSF_SL + sl]++;
+	stats->timed[type]++;
+	stats->latency_total[type] += ns;
+	if (ns > stats->latency_max[type])
+		stats->latency_max[type] = ns;
+}
+
+/*
+	Latenta sub care se afla permille la mie dintre comenzile cronometrate de
+	tipul type:
+	capatul de sus al clasei din histograma in care se ajunge la ele, dar
+	nu mai mult decat maximul masurat.
+*/
+static long long stats_percentile(command_stats_t *stats, int type,
+								  int permille)
+{
+	long long need = (stats->timed[type] * permille + 999) / 1000, seen = 0;
+	for (int b = 0; b < STATS_BUCKETS; b++) {
+		seen = seen + stats->latency[type][b];
+		if (seen >= need && seen) {
+			long long end = tlsf_class_start((b + 1) / TLSF_SL,
+											 (b + 1) % TLSF_SL) - 1;
+			return end < stats->latency_max[type] ? end
+												  : stats->latency_max[type];
+		}
+	}
+	return stats->latency_max[type];
+}
+
+// marginile clasei k, de la min la 2^(k+1) - 1 (fara semn, pentru k = 62)
+static void stats_range(out_buf_t *out, long long min, int k)
+{
+	out_dec(out, min);
+	out_char(out, '-');
+	out_dec(out, (long long)((2ULL << k) - 1));
+}
+
+/*
+	functie pentru comanda STATS; citeste doar contoarele heap-ului (zero
+	daca nu exista unul) si latentele comenzilor, fara liste
+*/
+void stats_print(out_buf_t *out, sfl *heap, command_stats_t *commands)
+{
+	sfl_stats_t none = {0};
+	sfl_stats_t *stats = heap ? &heap->stats : &none;
+	out_str(out, "+++++STATS+++++\n");
+	dump_line(out, "Allocated memory: ", stats->allocated_bytes, " bytes\n");
+	// in modul buddy blocurile sunt puteri ale lui 2, cererile se rotunjesc
+	if (heap && heap->buddy)
+		dump_line(out, "Requested memory: ", stats->requested_bytes,
+				  " bytes\n");
+	dump_line(out, "Allocated blocks: ", stats->allocated_blocks, "\n");
+	dump_line(out, "Free memory: ", stats->free_bytes, " bytes\n");
+	dump_line(out, "Free blocks: ", stats->free_blocks, "\n");
+	if (heap && heap->huge_end != heap->huge_start) {
+		dump_line(out, "Free extent memory: ", stats->free_extent_bytes,
+				  " bytes\n");
+		dump_line(out, "Free extents: ", stats->free_extents, "\n");
+	}
+	dump_line(out, "Malloc hits: ", stats_total(stats->hits), "\n");
+	dump_line(out, "Malloc splits: ", stats_total(stats->splits), "\n");
+	dump_line(out, "Malloc misses: ", stats_total(stats->misses), "\n");
+	dump_line(out, "Free calls: ", stats->frees, "\n");
+	dump_line(out, "Invalid frees: ", stats->invalid_frees, "\n");
+	dump_line(out, "Merges: ", stats->merges, "\n");
+	dump_line(out, "Free block searches: ", stats->searches, "\n");
+	dump_line(out, "Search steps: ", stats->search_steps, "\n");
+	for (int k = 0; k < STATS_CLASSES; k++) {
+		if (!stats->hits[k] && !stats->splits[k] && !stats->misses[k])
+			continue;
+		out_str(out, "Sizes ");
+		stats_range(out, k ? 1LL << k : 0, k);
+		dump_line(out, ": ", stats->hits[k], " hit(s), ");
+		dump_line(out, "", stats->splits[k], " split(s), ");
+		dump_line(out, "", stats->misses[k], " miss(es)\n");
+	}
+	for (int k = 0; k < STATS_CLASSES; k++) {
+		if (!stats->list_lengths[k])
+			continue;
+		out_str(out, "Lists with ");
+		stats_range(out, 1LL << k, k);
+		dump_line(out, " free blocks: ", stats->list_lengths[k], "\n");
+	}
+	for (int type = CMD_NONE + 1; type < CMD_TYPES; type++) {
+		long long timed = commands->timed[type];
+		if (!timed)
+			continue;
+		out_str(out, command_names[type]);
+		dump_line(out, " latency: ", commands->commands[type], " command(s), ");
+		dump_line(out, "", timed, " timed, ");
+		dump_line(out, "mean ", commands->latency_total[type] / timed, " ns, ");
+		dump_line(out, "p50 ", stats_percentile(commands, type, 500), " ns, ");
+		dump_line(out, "p99 ", stats_percentile(commands, type, 990), " ns, ");
+		dump_line(out, "max ", commands->latency_max[type], " ns\n");
+	}
+	out_str(out, "-----STATS-----\n");
+}
+
+// afiseaza ", "key": value" (fara virgula pentru primul camp)
+static void json_field(out_buf_t *out, int first, const char *key,
+					   long long value)
+{
+	out_str(out, first ? "\"" : ", \"");
+	out_str(out, key);
+	out_str(out, "\": ");
+	out_dec(out, value);
+}
+
+// STATS json: aceleasi statistici, ca un singur obiect JSON pe o linie
+void stats_print_json(out_buf_t *out, sfl *heap, command_stats_t *commands)
+{
+	sfl_stats_t none = {0};
+	sfl_stats_t *stats = heap ? &heap->stats : &none;
+	out_char(out, '{');
+	json_field(out, 1, "allocated_bytes", stats->allocated_bytes);
+	json_field(out, 0, "requested_bytes", stats->requested_bytes);
+	json_field(out, 0, "allocated_blocks", stats->allocated_blocks);
+	json_field(out, 0, "free_bytes", stats->free_bytes);
+	json_field(out, 0, "free_blocks", stats->free_blocks);
+	if (heap && heap->huge_end != heap->huge_start) {
+		json_field(out, 0, "free_extent_bytes", stats->free_extent_bytes);
+		json_field(out, 0, "free_extents", stats->free_extents);
+	}
+	json_field(out, 0, "hits", stats_total(stats->hits));
+	json_field(out, 0, "splits", stats_total(stats->splits));
+	json_field(out, 0, "misses", stats_total(stats->misses));
+	json_field(out, 0, "frees", stats->frees);
+	json_field(out, 0, "invalid_frees", stats->invalid_frees);
+	json_field(out, 0, "merges", stats->merges);
+	json_field(out, 0, "searches", stats->searches);
+	json_field(out, 0, "search_steps", stats->search_steps);
+
+	out_str(out, ", \"size_classes\": [");
+	for (int k = 0, first = 1; k < STATS_CLASSES; k++) {
+		if (!stats->hits[k] && !stats->splits[k] && !stats->misses[k])
+			continue;
+		out_str(out, first ? "{" : ", {");
+		first = 0;
+		json_field(out, 1, "min", k ? 1LL << k : 0);
+		json_field(out, 0, "max", (long long)((2ULL << k) - 1));
+		json_field(out, 0, "hits", stats->hits[k]);
+		json_field(out, 0, "splits", stats->splits[k]);
+		json_field(out, 0, "misses", stats->misses[k]);
+		out_char(out, '}');
+	}
+	out_str(out, "], \"list_lengths\": [");
+	for (int k = 0, first = 1; k < STATS_CLASSES; k++) {
+		if (!stats->list_lengths[k])
+			continue;
+		out_str(out, first ? "{" : ", {");
+		first = 0;
+		json_field(out, 1, "min", 1LL << k);
+		json_field(out, 0, "max", (long long)((2ULL << k) - 1));
+		json_field(out, 0, "lists", stats->list_lengths[k]);
+		out_char(out, '}');
+	}
+	out_str(out, "], \"latency_ns\": {");
+	for (int type = CMD_NONE + 1, first = 1; type < CMD_TYPES; type++) {
+		long long timed = commands->timed[type];
+		if (!timed)
+			continue;
+		out_str(out, first ? "\"" : ", \"");
+		first = 0;
+		out_str(out, command_names[type]);
+		out_str(out, "\": {");
+		json_field(out, 1, "count", commands->commands[type]);
+		json_field(out, 0, "timed", timed);
+		json_field(out, 0, "mean", commands->latency_total[type] / timed);
+		json_field(out, 0, "p50", stats_percentile(commands, type, 500));
+		json_field(out, 0, "p90", stats_percentile(commands, type, 900));
+		json_field(out, 0, "p99", stats_percentile(commands, type, 990));
+		json_field(out, 0, "p999", stats_percentile(commands, type, 999));
+		json_field(out, 0, "max", commands->latency_max[type]);
+		out_char(out, '}');
+	}
+	out_str(out, "}}\n");
+}
+
+/*
+	returneaza pozitia primei liste din vector ale carei blocuri au cel putin
+	dimension octeti (nr_lists daca nu exista), prin cautare binara
+*/
+int lower_list(sfl *heap, sfl_addr_t dimension)
+{
+	int left = 0, right = heap->nr_lists;
+	while (left < right) {
+		heap->stats.search_steps++;
+		int mid = left + (right - left) / 2;
+		if (heap->capacity[mid] < dimension)
+			left = mid + 1;
+		else
+			right = mid;
+	}
+	return left;
+}
+
+/*
+	verifica daca exista o lista de dimensiune dimension in sfl si returneaza
+	pozitia ei din vector, altfel returneaza -1
+*/
+int exist_list(sfl *heap, sfl_addr_t dimension)
+{
+	int i = lower_list(heap, dimension);
+	if (i < heap->nr_lists && heap->capacity[i] == dimension)
+		return i;
+	return -1;
+}
+
+// prima lista nevida dintre pozitiile [from, to), sau -1, direct din bitmap
+static int next_nonempty(sfl *heap, int from, int to)
+{
+	if (from >= to)
+		return -1;
+	int w = from / WORD_BITS, last = (to - 1) / WORD_BITS;
+	unsigned long long bits = heap->nonempty[w] & (~0ULL << (from % WORD_BITS));
+	heap->stats.search_steps++;
+	while (!bits) {
+		if (++w > last)
+			return -1;
+		heap->stats.search_steps++;
+		bits = heap->nonempty[w];
+	}
+	int i = w * WORD_BITS + __builtin_ctzll(bits);
+	return i < to ? i : -1;
+}
+
+/*
+	Best-fit: prima lista cu blocuri suficient de mari se gaseste prin
+	cautare binara in vectorul sortat de dimensiuni, iar prima lista nevida
+	de la ea incolo direct din bitmap.
+*/
+static int best_fit(sfl *heap, sfl_addr_t nr_bytes)
+{
+	return next_nonempty(heap, lower_list(heap, nr_bytes), heap->nr_lists);
+}
+
+/*
+	Primul bloc suficient de mare de la adresa from incolo. Blocurile cu
+	noduri se cauta in free_index, sarind subarborii cu blocuri prea mici;
+	blocuri fara noduri au doar listele zonelor initiale, unde primul de dupa
+	from se calculeaza direct. Returneaza pozitia listei sau -1, iar adresa
+	blocului ramane in heap->next_block.
+*/
+static int fit_from(sfl *heap, sfl_addr_t nr_bytes, sfl_addr_t from)
+{
+	int found = -1;
+	sfl_addr_t address = 0;
+	for (int r = 0; r < heap->nr_regions && r + 3 < 63; r++) {
+		sfl_addr_t capacity = (sfl_addr_t)8 << r;
+		int i = capacity < nr_bytes ? -1 : exist_list(heap, capacity);
+		if (i == -1)	// lista zonei a fost scoasa cand a ramas goala
+			continue;
+		heap->stats.search_steps++;
+		dl_list_t *list = heap->memory[i];
+		if (!list->lazy_count ||
+			list->lazy_address + (list->lazy_count - 1) * capacity < from)
+			continue;
+		sfl_addr_t first = list->lazy_address;
+		if (first < from)
+			first = first + (from - first + capacity - 1) / capacity *
+							capacity;
+		if (found == -1 || first < address) {
+			found = i;
+			address = first;
+		}
+	}
+	tree_node_t *t = tree_ceil_fit(heap->free_index, from, nr_bytes,
+								   &heap->stats.search_steps);
+	if (t && (found == -1 || t->key < address)) {
+		found = exist_list(heap, t->node->data.dimension);
+		address = t->key;
+	}
+	heap->next_block = address;
+	return found;
+}
+
+// first-fit: blocul suficient de mare cu adresa minima
+static int first_fit(sfl *heap, sfl_addr_t nr_bytes)
+{
+	return fit_from(heap, nr_bytes, heap->regions[0]);
+}
+
+/*
+	Next-fit: primul bloc suficient de mare de la heap->rover incolo, iar
+	daca nu exista, primul de la inceputul heap-ului.
+*/
+static int next_fit(sfl *heap, sfl_addr_t nr_bytes)
+{
+	int found = fit_from(heap, nr_bytes, heap->rover);
+	if (found == -1)	// se reia de la inceputul heap-ului
+		found = first_fit(heap, nr_bytes);
+	return found;
+}
+
+/*
+	Prima lista nevida din clasa TLSF (fl, sl) cu blocuri de cel putin from
+	octeti, sau -1. Bitmap-ul se parcurge doar pe listele clasei, nu si pe
+	cele goale de dupa ea.
+*/
+static int tlsf_class_list(sfl *heap, sfl_addr_t from, int fl, int sl)
+{
+	unsigned long long end = tlsf_class_start(fl, sl + 1);
+	int to = end > LLONG_MAX ? heap->nr_lists : lower_list(heap, end);
+	return next_nonempty(heap, lower_list(heap, from), to);
+}
+
+/*
+	TLSF: cererea se rotunjeste la inceputul clasei urmatoare, asa ca orice
+	bloc dintr-o clasa nevida de la ea incolo ajunge; clasa se gaseste cu
+	doua find-first-set, pe bitii primului nivel si ai celui de-al doilea.
+	Din clasa gasita se ia lista cu blocurile cele mai mici, care nu depinde
+	de ordinea in care s-au eliberat blocurile. Daca nu exista o astfel de
+	clasa, blocurile potrivite pot fi doar in clasa cererii: un bit spune
+	daca e goala, iar altfel se cauta doar printre listele ei.
+*/
+static int tlsf_fit(sfl *heap, sfl_addr_t nr_bytes)
+{
+	unsigned long long size = nr_bytes < 0 ? 0 : nr_bytes;
+	if (size >= TLSF_SL)
+		size = size + (1ULL << (63 - __builtin_clzll(size) - TLSF_SL_LOG)) - 1;
+	int fl, sl;
+	tlsf_mapping(size, &fl, &sl);
+	unsigned int map = heap->tlsf_second[fl] & (~0U << sl);
+	if (!map && fl + 1 < TLSF_FL) {
+		unsigned long long first = heap->tlsf_first & (~0ULL << (fl + 1));
+		if (first) {
+			fl = __builtin_ctzll(first);
+			map = heap->tlsf_second[fl];
+		}
+	}
+	if (map) {
+		sl = __builtin_ctz(map);
+		return best_fit(heap, tlsf_class_start(fl, sl));
+	}
+	tlsf_mapping(nr_bytes < 0 ? 0 : nr_bytes, &fl, &sl);
+	if (!(heap->tlsf_second[fl] & (1U << sl)))
+		return -1;
+	return tlsf_class_list(heap, nr_bytes, fl, sl);
+}
+
+// 1 daca o alocare de nr_bytes octeti se ia din zona alocarilor mari
+static int is_huge(sfl *heap, sfl_addr_t nr_bytes)
+{
+	return heap->huge_end != heap->huge_start &&
+		   nr_bytes > heap->huge_threshold;
+}
+
+/*
+	Blocul ocupat de o alocare de nr_bytes octeti: exact cat cererea; o
+	alocare mare, rotunjita la SFL_PAGE (daca incape in zona ei); in modul
+	buddy, cea mai mica putere a lui 2, de la 8 in sus, care o cuprinde.
+*/
+static sfl_addr_t block_size(sfl *heap, sfl_addr_t nr_bytes)
+{
+	if (is_huge(heap, nr_bytes))
+		return nr_bytes > heap->huge_end - heap->huge_start ? nr_bytes :
+			   (nr_bytes + SFL_PAGE - 1) / SFL_PAGE * SFL_PAGE;
+	if (!heap->buddy || nr_bytes > ((sfl_addr_t)1 << 62))
+		return nr_bytes;
+	if (nr_bytes <= 8)
+		return 8;
+	return (sfl_addr_t)1 << (64 - __builtin_clzll(nr_bytes - 1));
+}
+
+/*
+	Functie care cauta in vectorul de liste un bloc de memorie pentru comanda
+	malloc, dupa politica heap-ului, si returneaza pozitia listei din
+	vectorul de liste din care se ia blocul sau -1 in caz ca nu s-a gasit un
+	bloc de memorie. Se va schimba si valoarea parametrului frag, in caz ca
+	blocul se va fragmenta.
+*/
+int find_block(sfl *heap, sfl_addr_t nr_bytes, int *frag)
+{
+	int position;
+	sfl_addr_t size = block_size(heap, nr_bytes);
+	heap->stats.searches++;
+	switch (heap->policy) {
+	case POLICY_FIRST:
+		position = first_fit(heap, size);
+		break;
+	case POLICY_NEXT:
+		position = next_fit(heap, size);
+		break;
+	case POLICY_TLSF:
+		position = tlsf_fit(heap, size);
+		break;
+	default:
+		position = best_fit(heap, size);
+	}
+	if (position == -1)
+		return -1;
+
+	if (heap->capacity[position] != size)
+		*frag = 1;
+		// else, frag ramane 0, deci nu se fragmeneaza
+
+	return position;
+}
+
+/*
+	Scoate din vector listele ramase fara blocuri, pastrand ordinea celorlalte.
+	Listele goale sunt mutate dupa ultima lista folosita, ca sa fie refolosite
+	de add_new_list in loc sa fie create din nou.
+*/
+void compact_lists(sfl *heap)
+{
+	int i, kept = 0, nr_empty = 0;
+	dl_list_t **empty = malloc(heap->nr_lists * sizeof(*empty));
+	DIE(!empty, "malloc failed...");
+	for (i = 0; i < heap->nr_lists; i++) {
+		if (list_blocks(heap->memory[i]) != 0) {
+			heap->memory[kept] = heap->memory[i];
+			heap->capacity[kept] = heap->capacity[i];
+			kept++;
+		} else {
+			empty[nr_empty++] = heap->memory[i];
+		}
+	}
+	memcpy(heap->memory + kept, empty, nr_empty * sizeof(*empty));
+	free(empty);
+	heap->nr_lists = kept;
+	rebuild_bitmap(heap);
+}
+
+/*
+	Adauga o noua lista goala pentru blocuri de o noua dimensiune direct pe
+	pozitia care pastreaza vectorul de liste sortat dupa dimensiunea unui bloc
+	si returneaza aceasta pozitie. Cand vectorul e plin, se elimina mai intai
+	listele goale si doar daca nu se elibereaza suficient loc se dubleaza
+	dimensiunea lui.
+*/
+int add_new_list(sfl *heap, sfl_addr_t new_dim)
+{
+	if (heap->nr_lists == heap->max_lists) {
+		compact_lists(heap);
+		if (heap->nr_lists >= heap->max_lists - heap->max_lists / 4)
+			resize_list_vector(heap, 2 * heap->max_lists);
+	}
+
+	// pozitia pe care trebuie inserata lista, ca vectorul sa ramana sortat
+	int pos = lower_list(heap, new_dim);
+	dl_list_t *list = heap->memory[heap->nr_lists];
+	if (!list)
+		list = dll_create(&heap->nodes);
+	memmove(heap->memory + pos + 1, heap->memory + pos,
+			(heap->nr_lists - pos) * sizeof(*heap->memory));
+	memmove(heap->capacity + pos + 1, heap->capacity + pos,
+			(heap->nr_lists - pos) * sizeof(*heap->capacity));
+	insert_bit(heap, pos);
+	heap->nr_lists++;
+	heap->memory[pos] = list;
+	heap->capacity[pos] = new_dim;
+	return pos;
+}
+
+/*
+	returneaza adresa blocului creat la INIT_HEAP care contine adresa address
+	si pune in dimension dimensiunea acestuia
+*/
+sfl_addr_t block_origin(sfl *heap, sfl_addr_t address, sfl_addr_t *dimension)
+{
+	// ultima zona care incepe inainte de address
+	int left = 0, right = heap->nr_regions - 1;
+	while (left < right) {
+		int mid = left + (right - left + 1) / 2;
+		if (heap->regions[mid] <= address)
+			left = mid;
+		else
+			right = mid - 1;
+	}
+	*dimension = (sfl_addr_t)8 << left;
+	return heap->regions[left] +
+		   (address - heap->regions[left]) / *dimension * *dimension;
+}
+
+/*
+	Fragmentarea heap-ului: partea din memoria libera care se afla in bucati
+	ramase din impartirea blocurilor create la INIT_HEAP, adica in blocuri
+	libere care nu mai sunt blocuri initiale intregi. E 0 pentru un heap nou
+	si se apropie de 1 cand toata memoria libera e taiata in bucati.
+*/
+double fragmentation_ratio(sfl *heap)
+{
+	long long free_memory = 0, pieces = 0;
+	for (int i = 0; i < heap->nr_lists; i++) {
+		dl_list_t *list = heap->memory[i];
+		sfl_addr_t dim = heap->capacity[i], origin_dim;
+		// blocurile fara noduri sunt mereu blocuri initiale intregi
+		free_memory = free_memory + list_blocks(list) * dim;
+		dll_node_t *node = list->head;
+		for (int j = 0; j < list->size; j++) {
+			sfl_addr_t address = node ? node->data.address
+									  : offset_address(heap, list, j);
+			if (block_origin(heap, address, &origin_dim) != address ||
+				origin_dim != dim)
+				pieces = pieces + dim;
+			if (node)
+				node = node->next;
+		}
+	}
+	if (free_memory == 0)
+		return 0;
+	return (double)pieces / free_memory;
+}
+
+// memoria libera din blocurile de cel putin dimension octeti
+long long free_bytes_from(sfl *heap, sfl_addr_t dimension)
+{
+	long long bytes = 0;
+	for (int i = lower_list(heap, dimension); i < heap->nr_lists; i++)
+		bytes = bytes + list_blocks(heap->memory[i]) * heap->capacity[i];
+	return bytes;
+}
+
+/*
+	Arborele de adrese al blocurilor libere din list: cel comun (free_index)
+	sau, in modul buddy, arborele listei, in care FREE cauta buddy-ul unui
+	bloc; NULL daca blocurile libere nu au arbore.
+*/
+static tree_node_t **free_tree(sfl *heap, dl_list_t *list)
+{
+	if (heap->buddy)
+		return &list->index;
+	return heap->indexed ? &heap->free_index : NULL;
+}
+
+/*
+	Memoria folosita pentru a retine blocurile libere cu adresa: vectorii de
+	distante, inclusiv pozitiile nefolosite, sau nodurile de lista si de
+	arbore. Blocurile fara noduri nu costa nimic.
+*/
+long long free_list_bytes(sfl *heap)
+{
+	long long bytes = 0;
+	for (int i = 0; i < heap->max_lists; i++) {
+		dl_list_t *list = heap->memory[i];
+		if (!list)
+			continue;
+		bytes = bytes + (long long)list->max_offsets * sizeof(sfl_offset_t);
+		if (!heap->compact)
+			bytes = bytes + (long long)list->size *
+							(sizeof(dll_node_t) + sizeof(tree_node_t));
+	}
+	return bytes;
+}
+
+/*
+	add_free_run fara arbore de adrese: blocurile se interclaseaza de la
+	sfarsit cu distantele listei, asa ca se muta doar distantele mai mici
+	decat ultimul bloc adaugat. Vectorul isi dubleaza dimensiunea cand se
+	umple.
+*/
+static void add_free_offsets(sfl *heap, dl_list_t *list,
+							 sfl_addr_t *addresses, int n, sfl_addr_t dimension)
+{
+	int skip = -1;
+	sfl_addr_t origin_dim;
+	for (int j = 0; j < n && list->lazy_count; j++)
+		if (addresses[j] == list->lazy_address - dimension &&
+			block_origin(heap, addresses[j], &origin_dim) == addresses[j] &&
+			origin_dim == dimension) {
+			// blocul initial din fata blocurilor fara noduri merge la ele
+			list->lazy_address = addresses[j];
+			list->lazy_count++;
+			skip = j;
+			break;
+		}
+
+	int added = skip == -1 ? n : n - 1;
+	if (list->size + added > list->max_offsets) {
+		int max = list->max_offsets ? 2 * list->max_offsets : MIN_OFFSETS;
+		while (max < list->size + added)
+			max = 2 * max;
+		list->offsets = realloc(list->offsets, max * sizeof(sfl_offset_t));
+		DIE(!list->offsets, "realloc failed...");
+		list->max_offsets = max;
+	}
+
+	sfl_offset_t *offsets = list->offsets;
+	int old = list->size - 1, k = list->size + added - 1;
+	for (int j = 0; j < n; j++) {
+		if (j == skip)
+			continue;
+		sfl_offset_t offset = addresses[j] - heap->regions[0];
+		while (old >= 0 && offsets[old] < offset)
+			offsets[k--] = offsets[old--];
+		offsets[k--] = offset;
+	}
+	list->size = list->size + added;
+}
+
+/*
+	Adauga blocurile libere addresses[0..n), date in ordinea crescatoare a
+	adreselor si toate de dimensiune dimension, in lista blocurilor de
+	dimensiunea lor, creand lista daca nu exista. Blocurile se interclaseaza
+	cu nodurile listei intr-o singura parcurgere. Cand blocurile libere se
+	reunesc (type 1), fiecare bloc este retinut si in arborele de adrese; in
+	modul buddy, in arborele listei, care da si locul blocului in lista. Un
+	bloc initial eliberat chiar inaintea blocurilor fara noduri ale listei se
+	adauga la acestea, fara sa i se creeze nod.
+*/
+void add_free_run(sfl *heap, sfl_addr_t *addresses, int n,
+				  sfl_addr_t dimension)
+{
+	int i = exist_list(heap, dimension);	// cautam o lista
+	if (i == -1)
+		i = add_new_list(heap, dimension);	// inseram o lista
+
+	dl_list_t *list = heap->memory[i];
+	for (int j = 0; heap->logging && j < n; j++)
+		log_change(heap, 0, addresses[j], dimension, 1);
+	if (heap->compact) {
+		add_free_offsets(heap, list, addresses, n, dimension);
+		mark_list(heap, i);
+		return;
+	}
+	tree_node_t **tree = free_tree(heap, list);
+	dll_node_t *prev = NULL;	// ultimul nod cu adresa mai mica
+	for (int j = 0; j < n; j++) {
+		sfl_addr_t address = addresses[j], origin_dim;
+		if (list->lazy_count && address == list->lazy_address - dimension &&
+			block_origin(heap, address, &origin_dim) == address &&
+			origin_dim == dimension) {
+			// blocul initial din fata blocurilor fara noduri merge la ele
+			list->lazy_address = address;
+			list->lazy_count++;
+			continue;
+		}
+
+		if (heap->buddy) {
+			tree_node_t *floor = tree_floor(list->index, address);
+			prev = floor ? floor->node : NULL;
+		}
+		dll_node_t *next = prev ? prev->next : list->head;
+		while (next && next->data.address < address) {
+			prev = next;
+			next = next->next;
+		}
+		info block;
+		block.address = address;
+		block.dimension = dimension;
+		prev = dll_add_after(list, prev, &block);
+		if (tree)
+			tree_insert(&heap->tree_nodes, tree, address, prev);
+	}
+	mark_list(heap, i);
+}
+
+// adauga un bloc liber in lista blocurilor de dimensiunea lui
+void add_free_block(sfl *heap, sfl_addr_t address, sfl_addr_t dimension)
+{
+	add_free_run(heap, &address, 1, dimension);
+}
+
+// scoate din lista lui un bloc liber si elibereaza nodul
+void remove_free_block(sfl *heap, dll_node_t *node)
+{
+	int i = exist_list(heap, node->data.dimension);
+	dll_remove_node(heap->memory[i], node);
+	mark_list(heap, i);
+	log_change(heap, 0, node->data.address, node->data.dimension, -1);
+	tree_erase(&heap->tree_nodes, free_tree(heap, heap->memory[i]),
+			   node->data.address);
+	pool_free(&heap->nodes, node);
+}
+
+/*
+	Reuneste blocul liber [address, address + dimension) cu vecinii lui liberi
+	aflati imediat inainte si imediat dupa el, daca provin din acelasi bloc
+	creat la INIT_HEAP. Vecinii sunt gasiti in arborele de adrese al blocurilor
+	libere si sunt scosi din listele lor; blocul rezultat se intoarce prin
+	address si dimension.
+*/
+void merge_free_block(sfl *heap, sfl_addr_t *address, sfl_addr_t *dimension)
+{
+	sfl_addr_t origin_dim;
+	sfl_addr_t origin = block_origin(heap, *address, &origin_dim);
+
+	// vecinul din stanga se termina exact la adresa blocului
+	tree_node_t *left = tree_floor(heap->free_index, *address - 1);
+	if (left && left->key >= origin) {
+		info *data = &left->node->data;
+		if (data->address + data->dimension == *address) {
+			*address = data->address;
+			*dimension = *dimension + data->dimension;
+			remove_free_block(heap, left->node);
+			heap->stats.merges++;
+		}
+	}
+
+	// vecinul din dreapta incepe exact la finalul blocului
+	tree_node_t *right = tree_find(heap->free_index, *address + *dimension);
+	if (right && right->key < origin + origin_dim) {
+		*dimension = *dimension + right->node->data.dimension;
+		remove_free_block(heap, right->node);
+		heap->stats.merges++;
+	}
+}
+
+/*
+	Modul buddy: blocul eliberat, rotunjit la puterea lui 2 ocupata, se
+	reuneste cu buddy-ul lui cat timp acesta e liber si nu s-a refacut blocul
+	creat la INIT_HEAP. Buddy-ul unui bloc de dimensiune d are distanta fata
+	de blocul initial cu bitul lui d schimbat si se cauta doar in arborele
+	listei de dimensiune d, asa ca reunirea costa O(log) pentru fiecare din
+	cele cel mult log(dimensiune maxima) niveluri.
+*/
+static void merge_buddy(sfl *heap, sfl_addr_t *address, sfl_addr_t *dimension)
+{
+	sfl_addr_t origin_dim;
+	sfl_addr_t origin = block_origin(heap, *address, &origin_dim);
+	*dimension = block_size(heap, *dimension);
+	while (*dimension < origin_dim) {
+		sfl_addr_t buddy = origin + ((*address - origin) ^ *dimension);
+		int i = exist_list(heap, *dimension);
+		tree_node_t *found = i == -1 ? NULL :
+							 tree_find(heap->memory[i]->index, buddy);
+		if (!found)
+			break;
+		remove_free_block(heap, found->node);
+		if (buddy < *address)
+			*address = buddy;
+		*dimension = 2 * *dimension;
+		heap->stats.merges++;
+	}
+}
+
+// adresa cea mai mica dintre blocurile cu adresa ale unei liste nevide
+static sfl_addr_t lowest_address(sfl *heap, dl_list_t *list)
+{
+	if (heap->compact)
+		return offset_address(heap, list, list->size - 1);
+	return list->head->data.address;
+}
+
+/*
+	Scoate din lista de pe pozitia index blocul liber cu cea mai mica adresa
+	si returneaza adresa lui. Blocul poate fi un nod sau primul dintre blocurile
+	consecutive pentru care inca nu s-au creat noduri.
+*/
+sfl_addr_t take_free_block(sfl *heap, int index)
+{
+	dl_list_t *list = heap->memory[index];
+	sfl_addr_t addr;
+	if (list->lazy_count && (!list->size ||
+		list->lazy_address < lowest_address(heap, list))) {
+		addr = list->lazy_address;
+		list->lazy_address = addr + heap->capacity[index];
+		list->lazy_count--;
+	} else if (heap->compact) {
+		addr = lowest_address(heap, list);
+		list->size--;
+		// vectorul se injumatateste cand ramane folosit sub un sfert
+		if (list->max_offsets > MIN_OFFSETS &&
+			list->size < list->max_offsets / 4) {
+			list->max_offsets = list->max_offsets / 2;
+			list->offsets = realloc(list->offsets, list->max_offsets *
+									sizeof(sfl_offset_t));
+			DIE(!list->offsets, "realloc failed...");
+		}
+	} else {
+		dll_node_t *node = ll_remove_nth_node(list, 0);
+		addr = node->data.address;
+		tree_node_t **tree = free_tree(heap, list);
+		if (tree)
+			tree_erase(&heap->tree_nodes, tree, addr);
+		pool_free(&heap->nodes, node);
+	}
+	mark_list(heap, index);
+	log_change(heap, 0, addr, heap->capacity[index], -1);
+	return addr;
+}
+
+// adresa cea mai mica dintr-o lista nevida (nod sau bloc fara nod)
+static sfl_addr_t first_address(sfl *heap, dl_list_t *list)
+{
+	if (list->lazy_count && (!list->size ||
+		list->lazy_address < lowest_address(heap, list)))
+		return list->lazy_address;
+	return lowest_address(heap, list);
+}
+
+/*
+	Scoate din lista de pe pozitia index blocul liber care incepe la address
+	(ales de next-fit). Daca blocul e printre cele fara noduri, blocurile fara
+	noduri dinaintea lui primesc noduri, ca cele ramase sa fie tot
+	consecutive.
+*/
+sfl_addr_t take_block_at(sfl *heap, int index, sfl_addr_t address)
+{
+	dl_list_t *list = heap->memory[index];
+	sfl_addr_t capacity = heap->capacity[index];
+	if (address == first_address(heap, list))
+		return take_free_block(heap, index);
+
+	if (list->lazy_count && address >= list->lazy_address &&
+		address < list->lazy_address + list->lazy_count * capacity) {
+		sfl_addr_t before = (address - list->lazy_address) / capacity;
+		sfl_addr_t *blocks = malloc((before ? before : 1) * sizeof(*blocks));
+		DIE(!blocks, "malloc failed...");
+		for (sfl_addr_t i = 0; i < before; i++)
+			blocks[i] = list->lazy_address + i * capacity;
+		list->lazy_address = address + capacity;
+		list->lazy_count = list->lazy_count - before - 1;
+		// blocurile dinainte doar primesc noduri, nu sunt schimbari
+		int logging = heap->logging;
+		heap->logging = 0;
+		add_free_run(heap, blocks, before, capacity);
+		heap->logging = logging;
+		free(blocks);
+	} else {
+		dll_node_t *node = tree_find(heap->free_index, address)->node;
+		dll_remove_node(list, node);
+		tree_erase(&heap->tree_nodes, &heap->free_index, address);
+		pool_free(&heap->nodes, node);
+	}
+	mark_list(heap, index);
+	log_change(heap, 0, address, capacity, -1);
+	return address;
+}
+
+/*
+	Zonele continue de blocuri alocate se tin in heap->runs, ordonate dupa
+	adresa si indexate in arbore. Doua zone nu sunt niciodata lipite, asa ca
+	READ si WRITE verifica o zona cu o singura cautare in arbore. Campul
+	max_dimension al acestui arbore nu se foloseste si nu se actualizeaza
+	cand o zona creste.
+*/
+
+// schimba adresa de inceput a zonei node, mutand-o si in arbore
+static void run_move(sfl *heap, dll_node_t *node, sfl_addr_t address)
+{
+	tree_erase(&heap->tree_nodes, &heap->runs->index, node->data.address);
+	node->data.dimension -= address - node->data.address;
+	node->data.address = address;
+	tree_insert(&heap->tree_nodes, &heap->runs->index, address, node);
+}
+
+// scoate zona node din lista si din arbore
+static void run_erase(sfl *heap, dll_node_t *node)
+{
+	tree_erase(&heap->tree_nodes, &heap->runs->index, node->data.address);
+	pool_free(&heap->nodes, dll_remove_node(heap->runs, node));
+}
+
+// adauga octetii [address, address + dimension), lipindu-i de vecini
+static void run_add(sfl *heap, sfl_addr_t address, sfl_addr_t dimension)
+{
+	tree_node_t *floor = tree_floor(heap->runs->index, address);
+	dll_node_t *left = floor ? floor->node : NULL;
+	dll_node_t *right = left ? left->next : heap->runs->head;
+	sfl_addr_t end = address + dimension;
+
+	if (left && left->data.address + left->data.dimension == address) {
+		left->data.dimension += dimension;
+		if (right && right->data.address == end) {
+			left->data.dimension += right->data.dimension;
+			run_erase(heap, right);
+		}
+	} else if (right && right->data.address == end) {
+		run_move(heap, right, address);
+	} else {
+		info run;
+		run.address = address;
+		run.dimension = dimension;
+		dll_node_t *node = dll_add_after(heap->runs, left, &run);
+		tree_insert(&heap->tree_nodes, &heap->runs->index, address, node);
+	}
+}
+
+// scoate octetii [address, address + dimension) din zona care ii contine
+static void run_remove(sfl *heap, sfl_addr_t address, sfl_addr_t dimension)
+{
+	dll_node_t *run = tree_floor(heap->runs->index, address)->node;
+	sfl_addr_t end = address + dimension;
+	sfl_addr_t run_end = run->data.address + run->data.dimension;
+
+	if (run->data.address == address) {
+		if (end == run_end)
+			run_erase(heap, run);
+		else
+			run_move(heap, run, end);
+		return;
+	}
+	run->data.dimension = address - run->data.address;
+	if (end < run_end) {
+		info rest;
+		rest.address = end;
+		rest.dimension = run_end - end;
+		dll_node_t *node = dll_add_after(heap->runs, run, &rest);
+		tree_insert(&heap->tree_nodes, &heap->runs->index, end, node);
+	}
+}
+
+/*
+	Adauga blocurile alocate addresses[0..n), in ordinea crescatoare a
+	adreselor si toate de nr_bytes octeti, in lista blocurilor alocate.
+	Primul se pune dupa blocul gasit in arborele de adrese, iar urmatoarele
+	dupa cel dinaintea lor, sarind peste blocurile alocate dintre ele, ca la
+	interclasare. Cand intre doua blocuri sunt prea multe blocuri alocate, se
+	cauta din nou in arbore.
+*/
+static void add_allocated_run(sfl *heap, sfl_addr_t *addresses, int n,
+							  sfl_addr_t nr_bytes)
+{
+	dl_list_t *mem_alloc = heap->mem_alloc;
+	dll_node_t *prev = NULL;
+	for (int i = 0; i < n; i++) {
+		sfl_addr_t address = addresses[i];
+		int steps = 0;
+		while (i && prev->next && prev->next->data.address < address &&
+			   steps++ < MERGE_STEPS)
+			prev = prev->next;
+		if (i == 0 || (prev->next && prev->next->data.address < address)) {
+			tree_node_t *floor = tree_floor(mem_alloc->index, address);
+			prev = floor ? floor->node : NULL;
+		}
+
+		info block;
+		block.address = address;
+		block.dimension = nr_bytes;
+		prev = dll_add_after(mem_alloc, prev, &block);
+		tree_insert(&heap->tree_nodes, &mem_alloc->index, address, prev);
+		log_change(heap, 1, address, nr_bytes, 1);
+	}
+
+	// blocurile lipite intre ele intra deodata in zonele continue
+	for (int i = 0, j; i < n; i = j) {
+		for (j = i + 1; j < n; j++)
+			if (addresses[j] != addresses[j - 1] + nr_bytes)
+				break;
+		run_add(heap, addresses[i], (j - i) * nr_bytes);
+	}
+	heap->stats.allocated_bytes += n * block_size(heap, nr_bytes);
+	heap->stats.requested_bytes += n * nr_bytes;
+	heap->stats.allocated_blocks += n;
+}
+
+/*
+	Extinderile libere ale zonei alocarilor mari se tin in heap->extents,
+	ordonate dupa adresa si indexate in arbore, ca zonele continue. O
+	extindere eliberata se reuneste imediat cu vecinii ei liberi, asa ca doua
+	extinderi libere nu sunt niciodata lipite.
+*/
+
+// scoate extinderea libera node din lista si din arbore
+static void extent_erase(sfl *heap, dll_node_t *node)
+{
+	heap->stats.free_extents--;
+	heap->stats.free_extent_bytes -= node->data.dimension;
+	log_change(heap, 2, node->data.address, node->data.dimension, -1);
+	tree_erase(&heap->tree_nodes, &heap->extents->index, node->data.address);
+	pool_free(&heap->nodes, dll_remove_node(heap->extents, node));
+}
+
+// adauga extinderea libera [address, address + dimension), lipita de vecini
+static void extent_add(sfl *heap, sfl_addr_t address, sfl_addr_t dimension)
+{
+	tree_node_t *floor = tree_floor(heap->extents->index, address);
+	dll_node_t *left = floor ? floor->node : NULL;
+	dll_node_t *right = left ? left->next : heap->extents->head;
+	if (right && right->data.address == address + dimension) {
+		dimension = dimension + right->data.dimension;
+		extent_erase(heap, right);
+	}
+	if (left && left->data.address + left->data.dimension == address) {
+		address = left->data.address;
+		dimension = dimension + left->data.dimension;
+		dll_node_t *prev = left->prev;
+		extent_erase(heap, left);
+		left = prev;
+	}
+
+	info extent;
+	extent.address = address;
+	extent.dimension = dimension;
+	dll_node_t *node = dll_add_after(heap->extents, left, &extent);
+	tree_insert(&heap->tree_nodes, &heap->extents->index, address, node);
+	heap->stats.free_extents++;
+	heap->stats.free_extent_bytes += dimension;
+	log_change(heap, 2, address, dimension, 1);
+}
+
+/*
+	Zona alocarilor mari incepe la prima adresa multiplu de SFL_PAGE de dupa
+	zonele listelor si e la inceput o singura extindere libera. Arena se
+	mapeaza din nou, ca sa cuprinda si zona, ceea ce pe un heap fara blocuri
+	alocate nu pierde nimic.
+*/
+void sfl_huge_init(sfl *heap, sfl_addr_t threshold, sfl_addr_t nr_bytes)
+{
+	sfl_addr_t start = heap->regions[heap->nr_regions];
+	start = (start + SFL_PAGE - 1) / SFL_PAGE * SFL_PAGE;
+	nr_bytes = nr_bytes / SFL_PAGE * SFL_PAGE;
+	if (nr_bytes <= 0 || threshold < 0 ||
+		heap->huge_end != heap->huge_start || heap->mem_alloc->size)
+		return;
+	heap->huge_threshold = threshold;
+	heap->huge_start = start;
+	heap->huge_end = start + nr_bytes;
+	heap->total_memory = heap->total_memory + nr_bytes;
+	extent_add(heap, start, nr_bytes);
+	arena_map(heap, heap->huge_end - heap->regions[0]);
+}
+
+/*
+	MALLOC_N pentru alocarile mari: fiecare bloc ia inceputul celei mai mici
+	extinderi libere care il cuprinde (best-fit in arborele de adrese), iar
+	restul extinderii ramane liber. Listele libere nu se ating.
+*/
+static int malloc_extents(sfl *heap, sfl_addr_t nr_bytes, int count,
+						  sfl_addr_t *addresses)
+{
+	sfl_addr_t size = block_size(heap, nr_bytes);
+	int done;
+	for (done = 0; done < count; done++) {
+		tree_node_t *best = NULL;
+		heap->stats.searches++;
+		tree_best_fit(heap->extents->index, size, &best,
+					  &heap->stats.search_steps);
+		if (!best) {
+			heap->stats.misses[stats_class(nr_bytes)] += count - done;
+			break;
+		}
+		info extent = best->node->data;
+		extent_erase(heap, best->node);
+		addresses[done] = extent.address;
+		add_allocated_run(heap, &extent.address, 1, nr_bytes);
+		if (extent.dimension == size) {
+			heap->stats.hits[stats_class(nr_bytes)]++;
+		} else {
+			heap->stats.splits[stats_class(nr_bytes)]++;
+			extent_add(heap, extent.address + size, extent.dimension - size);
+		}
+	}
+
+	for (int i = done; i < count; i++)
+		addresses[i] = SFL_OUT_OF_MEMORY;
+	return done;
+}
+
+/*
+	MALLOC_N: acelasi efect ca count comenzi MALLOC nr_bytes la rand. Cat timp
+	bucata ramasa dintr-un bloc e prea mica pentru urmatoarea alocare, toate
+	alocarile urmatoare se fac din aceeasi lista, asa ca lista se cauta o
+	singura data pentru un sir de blocuri, care se adauga apoi deodata in
+	lista blocurilor alocate, iar bucatile ramase in lista lor. In modul
+	buddy blocul se injumatateste pana la puterea lui 2 a cererii si
+	jumatatile de sus raman libere. Adresele se pun in addresses
+	(SFL_OUT_OF_MEMORY cand nu mai e memorie); returneaza cate blocuri s-au
+	alocat. O cerere de 0 sau mai putini octeti nu primeste niciun bloc.
+*/
+int sfl_malloc_n(sfl *heap, sfl_addr_t nr_bytes, int count,
+				 sfl_addr_t *addresses)
+{
+	if (is_huge(heap, nr_bytes))
+		return malloc_extents(heap, nr_bytes, count, addresses);
+
+	int done = 0;
+	while (nr_bytes > 0 && done < count) {
+		int frag = 0;	// presupunem ca nu se fragmenteaza
+		int index = find_block(heap, nr_bytes, &frag);
+		if (index == -1) {
+			heap->stats.misses[stats_class(nr_bytes)] += count - done;
+			break;
+		}
+
+		/*
+			first-fit si next-fit pot alege alt bloc dupa fiecare alocare,
+			asa ca blocurile se iau pe rand
+		*/
+		sfl_addr_t capacity = heap->capacity[index];
+		sfl_addr_t size = block_size(heap, nr_bytes);
+		int run = 1;
+		if ((heap->policy == POLICY_BEST || heap->policy == POLICY_TLSF) &&
+			capacity - size < size) {
+			sfl_addr_t available = list_blocks(heap->memory[index]);
+			run = available < count - done ? available : count - done;
+		}
+		sfl_addr_t *blocks = addresses + done;
+		if (heap->policy == POLICY_NEXT) {
+			blocks[0] = take_block_at(heap, index, heap->next_block);
+			heap->rover = blocks[0] + nr_bytes;
+		} else {
+			for (int i = 0; i < run; i++)
+				blocks[i] = take_free_block(heap, index);
+		}
+		add_allocated_run(heap, blocks, run, nr_bytes);
+		if (frag == 1)
+			heap->stats.splits[stats_class(nr_bytes)] += run;
+		else
+			heap->stats.hits[stats_class(nr_bytes)] += run;
+
+		if (frag == 1 && heap->buddy) {
+			for (sfl_addr_t half = capacity / 2; half >= size; half /= 2)
+				add_free_block(heap, blocks[0] + half, half);
+		} else if (frag == 1) {	// bucatile ramase, tot in ordinea adreselor
+			for (int i = 0; i < run; i++)
+				blocks[i] = blocks[i] + nr_bytes;
+			add_free_run(heap, blocks, run, capacity - nr_bytes);
+			for (int i = 0; i < run; i++)
+				blocks[i] = blocks[i] - nr_bytes;
+		}
+		done = done + run;
+	}
+
+	for (int i = done; i < count; i++)
+		addresses[i] = SFL_OUT_OF_MEMORY;
+	return done;
+}
+
+/*
+	functia pentru comanda malloc; returneaza adresa blocului alocat sau
+	SFL_OUT_OF_MEMORY daca nu exista niciun bloc liber suficient de mare sau
+	nr_bytes nu e pozitiv
+*/
+sfl_addr_t sfl_malloc(sfl *heap, sfl_addr_t nr_bytes)
+{
+	sfl_addr_t address;
+	sfl_malloc_n(heap, nr_bytes, 1, &address);
+	return address;
+}
+
+/*
+	functie pentru comanda free; pentru type 1 blocul eliberat se reuneste cu
+	vecinii lui liberi, iar in modul buddy cu buddy-ul lui, inainte sa fie
+	adaugat in vectorul de liste; returneaza SFL_OK sau SFL_INVALID_FREE
+*/
+int sfl_free(sfl *heap, sfl_addr_t address)
+{
+	dl_list_t *mem_alloc = heap->mem_alloc;
+	tree_node_t *found = tree_find(mem_alloc->index, address);
+	if (found) {	// daca s-a gasit un bloc de adresa address
+		dll_node_t *n_free = found->node;
+		sfl_addr_t dimension = n_free->data.dimension;
+		heap->stats.frees++;
+		heap->stats.allocated_bytes -= block_size(heap, dimension);
+		heap->stats.requested_bytes -= dimension;
+		heap->stats.allocated_blocks--;
+		run_remove(heap, address, dimension);
+		log_change(heap, 1, address, dimension, -1);
+		if (address >= heap->huge_start) {
+			// alocarile mari se intorc in extinderile libere, nu in liste
+			extent_add(heap, address, block_size(heap, dimension));
+		} else {
+			if (heap->type == 1)
+				merge_free_block(heap, &address, &dimension);
+			else if (heap->buddy)
+				merge_buddy(heap, &address, &dimension);
+			add_free_block(heap, address, dimension);
+		}
+
+		// stergem nodul din lista de blocuri de memorie alocata
+		tree_erase(&heap->tree_nodes, &mem_alloc->index, n_free->data.address);
+		dll_node_t *free_block = dll_remove_node(mem_alloc, n_free);
+		pool_free(&heap->nodes, free_block);
+		return SFL_OK;
+	}
+	heap->stats.invalid_frees++;
+	return SFL_INVALID_FREE;
+}
+
+// ordoneaza blocurile dupa dimensiune, apoi dupa adresa
+static int compare_blocks(const void *a, const void *b)
+{
+	const info *x = a, *y = b;
+	if (x->dimension != y->dimension)
+		return x->dimension < y->dimension ? -1 : 1;
+	return (x->address > y->address) - (x->address < y->address);
+}
+
+/*
+	FREE_N: acelasi efect ca cate o comanda FREE pentru fiecare adresa, in
+	ordine. Pentru type 0 blocurile se scot intai din lista celor alocate,
+	apoi se ordoneaza dupa dimensiune si adresa si se adauga in listele
+	libere cu o singura parcurgere pentru fiecare dimensiune. Pentru type 1
+	si modul buddy reunirea depinde de blocurile eliberate inainte, asa ca
+	blocurile se elibereaza pe rand, ca si alocarile mari. Returneaza cate
+	blocuri s-au eliberat.
+*/
+int sfl_free_n(sfl *heap, sfl_addr_t *addresses, int count)
+{
+	dl_list_t *mem_alloc = heap->mem_alloc;
+	if (heap->type == 1 || heap->buddy) {
+		int freed = 0;
+		for (int i = 0; i < count; i++)
+			if (sfl_free(heap, addresses[i]) == SFL_OK)
+				freed++;
+		return freed;
+	}
+
+	info *freed = malloc((count ? count : 1) * sizeof(info));
+	sfl_addr_t *run = malloc((count ? count : 1) * sizeof(*run));
+	DIE(!freed || !run, "malloc failed...");
+	int n = 0, extents = 0;
+	for (int i = 0; i < count; i++) {
+		if (addresses[i] >= heap->huge_start) {
+			extents = extents + (sfl_free(heap, addresses[i]) == SFL_OK);
+			continue;
+		}
+		tree_node_t *found = tree_find(mem_alloc->index, addresses[i]);
+		if (!found) {
+			heap->stats.invalid_frees++;
+			continue;
+		}
+		dll_node_t *node = found->node;
+		freed[n++] = node->data;
+		heap->stats.allocated_bytes -= node->data.dimension;
+		heap->stats.requested_bytes -= node->data.dimension;
+		run_remove(heap, node->data.address, node->data.dimension);
+		log_change(heap, 1, node->data.address, node->data.dimension, -1);
+		tree_erase(&heap->tree_nodes, &mem_alloc->index, addresses[i]);
+		pool_free(&heap->nodes, dll_remove_node(mem_alloc, node));
+	}
+	heap->stats.frees += n;
+	heap->stats.allocated_blocks -= n;
+
+	qsort(freed, n, sizeof(info), compare_blocks);
+	for (int i = 0, j; i < n; i = j) {
+		for (j = i; j < n && freed[j].dimension == freed[i].dimension; j++)
+			run[j - i] = freed[j].address;
+		add_free_run(heap, run, j - i, freed[i].dimension);
+	}
+	free(freed);
+	free(run);
+	return n + extents;
+}
+
+/*
+	fuctie care elibereaza memoria pentru o lista; nodurile raman in zona din
+	care au fost alocate si sunt eliberate odata cu slab-urile ei
+*/
+void ll_free(dl_list_t **list)
+{
+	if (!list || !*list)
+		return;
+
+	free((*list)->offsets);
+	free(*list);
+	*list = NULL;
+}
+
+/*
+	pregateste citirea comenzilor din fd; un fisier obisnuit se mapeaza
+	intreg, altfel se citeste pe bucati intr-un buffer
+*/
+void in_init(in_buf_t *in, int fd)
+{
+	struct stat st;
+	in->fd = fd;
+	in->pos = 0;
+	in->mapped = 0;
+	in->binary = 0;
+	in->version = 0;	// se afla din antetul trace-ului
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		in->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (in->data != MAP_FAILED) {
+			madvise(in->data, st.st_size, MADV_SEQUENTIAL);
+			in->len = st.st_size;
+			in->size = st.st_size;
+			in->eof = 1;
+			in->mapped = 1;
+			return;
+		}
+	}
+	in->size = IN_SIZE;
+	in->data = malloc(in->size);
+	DIE(!in->data, "malloc failed...");
+	in->len = 0;
+	in->eof = 0;
+}
+
+void in_free(in_buf_t *in)
+{
+	if (in->mapped)
+		munmap(in->data, in->size);
+	else
+		free(in->data);
+	if (in->fd != STDIN_FILENO)
+		close(in->fd);
+}
+
+/*
+	Aduce in buffer inca o bucata din intrare. Linia inceputa se muta la
+	inceputul bufferului, iar daca ocupa tot bufferul acesta se dubleaza.
+*/
+void in_fill(in_buf_t *in)
+{
+	if (in->pos) {
+		memmove(in->data, in->data + in->pos, in->len - in->pos);
+		in->len = in->len - in->pos;
+		in->pos = 0;
+	}
+	if (in->len == in->size) {
+		in->size = 2 * in->size;
+		in->data = realloc(in->data, in->size);
+		DIE(!in->data, "realloc failed...");
+	}
+	ssize_t ret = read(in->fd, in->data + in->len, in->size - in->len);
+	if (ret < 0 && errno == EINTR)
+		return;
+	DIE(ret < 0, "read failed...");
+	if (ret == 0)
+		in->eof = 1;
+	in->len = in->len + ret;
+}
+
+/*
+	returneaza inceputul urmatoarei linii si pune in *end sfarsitul ei (fara
+	'\n'), sau NULL daca s-a terminat intrarea
+*/
+char *in_line(in_buf_t *in, char **end)
+{
+	char *newline;
+	while (!(newline = memchr(in->data + in->pos, '\n', in->len - in->pos))) {
+		if (in->eof) {
+			if (in->pos == in->len)
+				return NULL;
+			// ultima linie nu se termina cu '\n'
+			newline = in->data + in->len;
+			break;
+		}
+		in_fill(in);
+	}
+	char *line = in->data + in->pos;
+	*end = newline;
+	in->pos = newline - in->data;
+	if (in->pos < in->len)
+		in->pos++;
+	return line;
+}
+
+// spatiu sau alt caracter de control ('\n' nu mai apare in linie)
+static int is_space(char c)
+{
+	return (unsigned char)c <= ' ';
+}
+
+// citeste un numar in baza 16, cu sau fara prefixul 0x, ca "%llx"
+sfl_addr_t parse_hex(char **p, char *end)
+{
+	char *s = *p;
+	unsigned long long x = 0;
+	while (s < end && is_space(*s))
+		s++;
+	if (end - s > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+		s = s + 2;
+	for (; s < end; s++) {
+		unsigned int digit = (unsigned char)*s - '0';
+		if (digit > 9) {
+			digit = ((unsigned char)*s | 32) - 'a';
+			if (digit > 5)
+				break;
+			digit = digit + 10;
+		}
+		x = x * 16 + digit;
+	}
+	*p = s;
+	return (sfl_addr_t)x;
+}
+
+// citeste un numar in baza 10, eventual cu semn, ca "%lld"
+long long parse_dec(char **p, char *end)
+{
+	char *s = *p;
+	int negative = 0;
+	unsigned long long x = 0;
+	while (s < end && is_space(*s))
+		s++;
+	if (s < end && (*s == '-' || *s == '+'))
+		negative = *s++ == '-';
+	for (; s < end && *s >= '0' && *s <= '9'; s++)
+		x = x * 10 + (*s - '0');
+	*p = s;
+	return negative ? -(long long)x : (long long)x;
+}
+
+/*
+	returneaza len daca linia incepe cu cuvantul cheie name, urmat de un
+	spatiu sau de sfarsitul liniei, altfel 0; name si len sunt constante,
+	asa ca memcmp se reduce la cateva comparatii
+*/
+static inline int keyword_at(char *word, char *end, const char *name, int len)
+{
+	if (end - word >= len && memcmp(word, name, len) == 0 &&
+		(word + len == end || is_space(word[len])))
+		return len;
+	return 0;
+}
+
+#define KEYWORD(word, end, name) keyword_at(word, end, name, sizeof(name) - 1)
+
+/*
+	Recunoaste comanda de la inceputul liniei. Prima litera alege cuvintele
+	cheie posibile (cel mult trei), care se compara apoi intregi. *p ajunge
+	dupa cuvant.
+*/
+int command_type(char **p, char *end)
+{
+	char *word = *p;
+	int type = CMD_NONE, len = 0;
+	if (word == end)
+		return CMD_NONE;
+	switch (word[0]) {
+	case 'I':
+		if ((len = KEYWORD(word, end, "INIT_HEAP")))
+			type = CMD_INIT_HEAP;
+		break;
+	case 'M':
+		if ((len = KEYWORD(word, end, "MALLOC")))
+			type = CMD_MALLOC;
+		else if ((len = KEYWORD(word, end, "MALLOC_N")))
+			type = CMD_MALLOC_N;
+		break;
+	case 'F':
+		if ((len = KEYWORD(word, end, "FREE")))
+			type = CMD_FREE;
+		else if ((len = KEYWORD(word, end, "FREE_N")))
+			type = CMD_FREE_N;
+		break;
+	case 'R':
+		if ((len = KEYWORD(word, end, "READ")))
+			type = CMD_READ;
+		break;
+	case 'S':
+		if ((len = KEYWORD(word, end, "STATS")))
+			type = CMD_STATS;
+		else if ((len = KEYWORD(word, end, "SAVE_SNAPSHOT")))
+			type = CMD_SAVE_SNAPSHOT;
+		break;
+	case 'L':
+		if ((len = KEYWORD(word, end, "LOAD_SNAPSHOT")))
+			type = CMD_LOAD_SNAPSHOT;
+		break;
+	case 'W':
+		if ((len = KEYWORD(word, end, "WRITE")))
+			type = CMD_WRITE;
+		break;
+	case 'D':
+		if ((len = KEYWORD(word, end, "DUMP_MEMORY")))
+			type = CMD_DUMP_MEMORY;
+		else if ((len = KEYWORD(word, end, "DUMP_DELTA")))
+			type = CMD_DUMP_DELTA;
+		else if ((len = KEYWORD(word, end, "DESTROY_HEAP")))
+			type = CMD_DESTROY_HEAP;
+		break;
+	}
+	*p = word + len;
+	return type;
+}
+
+void command_init(command_t *cmd)
+{
+	cmd->addresses = NULL;
+	cmd->max_addresses = 0;
+}
+
+void command_free(command_t *cmd)
+{
+	free(cmd->addresses);
+}
+
+// face loc pentru cel putin n adrese in cmd->addresses
+void command_reserve(command_t *cmd, int n)
+{
+	if (n <= cmd->max_addresses)
+		return;
+	int size = cmd->max_addresses ? cmd->max_addresses : 16;
+	while (size < n)
+		size = size * 2;
+	cmd->addresses = realloc(cmd->addresses, size * sizeof(*cmd->addresses));
+	DIE(!cmd->addresses, "realloc failed...");
+	cmd->max_addresses = size;
+}
+
+static const char *policy_names[] = {"best", "first", "next", "tlsf"};
+
+int policy_by_name(const char *name, int len)
+{
+	for (int i = 0; i < (int)(sizeof(policy_names) / sizeof(*policy_names));
+		 i++)
+		if ((int)strlen(policy_names[i]) == len &&
+			memcmp(name, policy_names[i], len) == 0)
+			return i;
+	return -1;
+}
+
+// urmatorul cuvant de pe linie, in *word; returneaza lungimea lui
+static int parse_word(char **p, char *end, char **word)
+{
+	char *start = *p;
+	while (start < end && is_space(*start))
+		start++;
+	char *stop = start;
+	while (stop < end && !is_space(*stop))
+		stop++;
+	*p = stop;
+	*word = start;
+	return stop - start;
+}
+
+// 1 daca urmatorul cuvant de pe linie e name
+static int parse_flag(char **p, char *end, const char *name)
+{
+	char *word;
+	int len = parse_word(p, end, &word);
+	return len == (int)strlen(name) && memcmp(word, name, len) == 0;
+}
+
+/*
+	Cuvintele optionale de dupa tipul heap-ului: politica de plasare,
+	implicit best, si "huge <prag> <octeti>" pentru zona alocarilor mari.
+	Cuvintele necunoscute se ignora.
+*/
+static void parse_init_options(char **p, char *end, command_t *cmd)
+{
+	char *word;
+	int len;
+	cmd->policy = POLICY_BEST;
+	cmd->huge_threshold = 0;
+	cmd->huge_bytes = 0;
+	while ((len = parse_word(p, end, &word)) > 0) {
+		int policy = policy_by_name(word, len);
+		if (policy != -1) {
+			cmd->policy = policy;
+		} else if (len == 4 && memcmp(word, "huge", 4) == 0) {
+			cmd->huge_threshold = parse_dec(p, end);
+			cmd->huge_bytes = parse_dec(p, end);
+		}
+	}
+}
 
+// adresele lui FREE_N, pana la sfarsitul liniei
+void parse_addresses(char **p, char *end, command_t *cmd)
+{
+	cmd->count = 0;
 	while (1) {
-		if (strcmp(command, "INIT_HEAP") == 0) {
-			scanf("%x%d%d%d", &heap->address, &heap->nr_lists, &heap->nr_bytes,
-				  &heap->type);
-			total_memory = heap->nr_lists * heap->nr_bytes;
-			// initializez vectorul de liste, si lista cu blocurile alocate
-			heap->memory = create_list_vector(heap);
-			mem_alloc = dll_create(sizeof(info));
-
-		} else if (strcmp(command, "MALLOC") == 0) {
-			scanf("%d", &heap->nr_bytes);
-			malloc_command(heap, mem_alloc, &malloc_calls, &nr_fragmentation);
-		} else if (strcmp(command, "FREE") == 0) {
-			scanf("%x", &heap->address);
-			free_command(heap, mem_alloc, &free_calls);
-
-		} else if (strcmp(command, "READ") == 0) {
-			scanf("%x%d", &heap->address, &heap->nr_bytes);
-
-			read_command(mem_alloc, heap->nr_bytes, heap->address, &dump);
-			if (dump == 1) {	// se va face dump
-				dump_print(heap, mem_alloc, total_memory, malloc_calls,
-						   nr_fragmentation, free_calls);
-				break;
-			}
-		} else if (strcmp(command, "WRITE") == 0) {
-			scanf("%x", &heap->address);
-			char *p;
-			char *string = scan_string(&heap->nr_bytes, &p);
-			write_command(mem_alloc, heap->address, heap->nr_bytes, string,
-						  &dump);
-			free(p);
-			if (dump == 1) {	// se va face dump
-				dump_print(heap, mem_alloc, total_memory, malloc_calls,
-						   nr_fragmentation, free_calls);
+		while (*p < end && is_space(**p))
+			(*p)++;
+		char *start = *p;
+		if (start == end)
+			break;
+		sfl_addr_t address = parse_hex(p, end);
+		if (*p == start)	// nu e un numar
+			break;
+		command_reserve(cmd, cmd->count + 1);
+		cmd->addresses[cmd->count++] = address;
+	}
+}
+
+// sirul lui WRITE: tot ce se afla intre primele si ultimele ghilimele
+void parse_string(char **p, char *end, command_t *cmd)
+{
+	char *start = memchr(*p, '"', end - *p);
+	char *stop = NULL;
+	for (char *q = end - 1; start && q > start; q--)
+		if (*q == '"') {
+			stop = q;
+			break;
+		}
+	if (!stop) {	// sirul lipseste
+		cmd->string = *p;
+		cmd->length = 0;
+		return;
+	}
+	cmd->string = start + 1;
+	cmd->length = stop - start - 1;
+	*p = stop + 1;
+}
+
+/*
+	Citeste comanda de pe linia [line, end). Pentru WRITE sirul este cel
+	dintre primele si ultimele ghilimele de pe linie, iar numarul de octeti
+	urmeaza dupa el; sirul nu se copiaza, cmd->string arata in linie.
+*/
+void parse_command(char *line, char *end, command_t *cmd)
+{
+	char *p = line;
+	while (p < end && is_space(*p))
+		p++;
+	cmd->type = command_type(&p, end);
+	switch (cmd->type) {
+	case CMD_INIT_HEAP:
+		cmd->address = parse_hex(&p, end);
+		cmd->nr_lists = parse_dec(&p, end);
+		cmd->nr_bytes = parse_dec(&p, end);
+		cmd->heap_type = parse_dec(&p, end);
+		parse_init_options(&p, end, cmd);
+		break;
+	case CMD_MALLOC:
+		cmd->nr_bytes = parse_dec(&p, end);
+		break;
+	case CMD_FREE:
+		cmd->address = parse_hex(&p, end);
+		break;
+	case CMD_READ:
+		cmd->address = parse_hex(&p, end);
+		cmd->nr_bytes = parse_dec(&p, end);
+		break;
+	case CMD_WRITE:
+		cmd->address = parse_hex(&p, end);
+		parse_string(&p, end, cmd);
+		cmd->nr_bytes = parse_dec(&p, end);
+		break;
+	case CMD_MALLOC_N:
+		cmd->nr_bytes = parse_dec(&p, end);
+		cmd->count = parse_dec(&p, end);
+		break;
+	case CMD_FREE_N:
+		parse_addresses(&p, end, cmd);
+		break;
+	case CMD_STATS:
+		cmd->json = parse_flag(&p, end, "json");
+		break;
+	case CMD_SAVE_SNAPSHOT:
+	case CMD_LOAD_SNAPSHOT:
+		cmd->length = parse_word(&p, end, &cmd->string);
+		break;
+	}
+}
+
+/*
+	Trace-ul binar incepe cu TRACE_MAGIC si versiunea formatului (4 octeti),
+	urmate de comenzi. Fiecare comanda are un octet cu tipul ei (valoarea din
+	enum command_type) si apoi parametrii, ca numere little endian. Adresele
+	si numerele de bytes au 8 octeti (4 pana la versiunea 3), iar ceilalti
+	parametri 4 octeti:
+		INIT_HEAP	adresa, numarul de liste, numarul de bytes, tipul,
+					politica de plasare (doar de la versiunea 2), pragul
+					si numarul de bytes ai alocarilor mari (doar de la
+					versiunea 4)
+		MALLOC		numarul de bytes
+		FREE		adresa
+		READ		adresa, numarul de bytes
+		WRITE		adresa, numarul de bytes, lungimea sirului, sirul
+		DUMP_MEMORY, DESTROY_HEAP, DUMP_DELTA	fara parametri
+		MALLOC_N	numarul de bytes, numarul de blocuri
+		FREE_N		numarul de adrese, adresele
+		STATS		1 pentru JSON, 0 pentru text
+		SAVE_SNAPSHOT, LOAD_SNAPSHOT	lungimea numelui fisierului, numele
+*/
+#define TRACE_MAGIC "SFLT"
+#define TRACE_VERSION 4
+#define TRACE_HEADER 8
+
+/*
+	cate adrese si numere de bytes, respectiv cate alte numere urmeaza dupa
+	tipul fiecarei comenzi
+*/
+static const int record_wide[] = {0, 4, 1, 1, 2, 2, 0, 0, 1, 0, 0, 0, 0, 0};
+static const int record_fields[] = {0, 3, 0, 0, 0, 1, 0, 0, 1, 1, 1, 1, 1, 0};
+
+// aduce in buffer cel putin n octeti de la pozitia curenta, daca exista
+int in_ensure(in_buf_t *in, size_t n)
+{
+	while (in->len - in->pos < n) {
+		if (in->eof)
+			return 0;
+		in_fill(in);
+	}
+	return 1;
+}
+
+static unsigned int get_u32(char *s)
+{
+	unsigned char *p = (unsigned char *)s;
+	return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+void put_u32(out_buf_t *out, unsigned int x)
+{
+	char bytes[4] = {x, x >> 8, x >> 16, x >> 24};
+	out_bytes(out, bytes, 4);
+}
+
+void put_u64(out_buf_t *out, unsigned long long x)
+{
+	put_u32(out, x);
+	put_u32(out, x >> 32);
+}
+
+// urmatorul numar pe 4 octeti din inregistrare
+static unsigned int next_u32(char **p)
+{
+	unsigned int x = get_u32(*p);
+	*p = *p + 4;
+	return x;
+}
+
+// urmatoarea adresa sau numar de bytes, pe width octeti
+static sfl_addr_t next_wide(char **p, int width)
+{
+	unsigned long long x = next_u32(p);
+	if (width == 8)
+		x = x | (unsigned long long)next_u32(p) << 32;
+	return (sfl_addr_t)x;
+}
+
+// verifica inceputul unui trace binar; returneaza 0 daca nu e unul valid
+int trace_header(in_buf_t *in)
+{
+	if (!in_ensure(in, TRACE_HEADER) ||
+		memcmp(in->data + in->pos, TRACE_MAGIC, 4) != 0)
+		return 0;
+	in->version = get_u32(in->data + in->pos + 4);
+	if (in->version < 1 || in->version > TRACE_VERSION)
+		return 0;
+	in->pos = in->pos + TRACE_HEADER;
+	return 1;
+}
+
+/*
+	sirul de la sfarsitul unei inregistrari de size octeti, dupa lungimea
+	lui; se adauga la size
+*/
+static int decode_string(in_buf_t *in, command_t *cmd, char **p, size_t *size)
+{
+	cmd->length = next_u32(p);
+	if (cmd->length < 0 || !in_ensure(in, *size + cmd->length)) {
+		fprintf(stderr, "Truncated trace record\n");
+		return 0;
+	}
+	// bufferul se poate muta cand se aduce sirul
+	cmd->string = in->data + in->pos + *size;
+	*size = *size + cmd->length;
+	return 1;
+}
+
+/*
+	Citeste urmatoarea comanda dintr-un trace binar. Sirul lui WRITE ramane
+	in buffer, ca la comenzile text. Returneaza 0 la sfarsitul trace-ului.
+*/
+int decode_command(in_buf_t *in, command_t *cmd)
+{
+	if (!in_ensure(in, 1))
+		return 0;
+	int type = (unsigned char)in->data[in->pos];
+	if (type <= CMD_NONE || type >= CMD_TYPES) {
+		fprintf(stderr, "Invalid trace record\n");
+		return 0;
+	}
+	int width = in->version < 3 ? 4 : 8;
+	size_t size = 1 + width * record_wide[type] + 4 * record_fields[type];
+	if (type == CMD_INIT_HEAP && in->version < 4)
+		size = size - 2 * width;	// fara zona alocarilor mari
+	if (type == CMD_INIT_HEAP && in->version == 1)
+		size = size - 4;	// fara politica de plasare
+	if (!in_ensure(in, size)) {
+		fprintf(stderr, "Truncated trace record\n");
+		return 0;
+	}
+
+	char *p = in->data + in->pos + 1;
+	cmd->type = type;
+	switch (type) {
+	case CMD_INIT_HEAP:
+		cmd->address = next_wide(&p, width);
+		cmd->nr_lists = next_u32(&p);
+		cmd->nr_bytes = next_wide(&p, width);
+		cmd->heap_type = next_u32(&p);
+		cmd->policy = in->version == 1 ? POLICY_BEST : (int)next_u32(&p);
+		if (cmd->policy < POLICY_BEST || cmd->policy > POLICY_TLSF)
+			cmd->policy = POLICY_BEST;
+		cmd->huge_threshold = in->version < 4 ? 0 : next_wide(&p, width);
+		cmd->huge_bytes = in->version < 4 ? 0 : next_wide(&p, width);
+		break;
+	case CMD_MALLOC:
+		cmd->nr_bytes = next_wide(&p, width);
+		break;
+	case CMD_FREE:
+		cmd->address = next_wide(&p, width);
+		break;
+	case CMD_READ:
+		cmd->address = next_wide(&p, width);
+		cmd->nr_bytes = next_wide(&p, width);
+		break;
+	case CMD_WRITE:
+		cmd->address = next_wide(&p, width);
+		cmd->nr_bytes = next_wide(&p, width);
+		if (!decode_string(in, cmd, &p, &size))
+			return 0;
+		break;
+	case CMD_MALLOC_N:
+		cmd->nr_bytes = next_wide(&p, width);
+		cmd->count = next_u32(&p);
+		break;
+	case CMD_FREE_N:
+		cmd->count = next_u32(&p);
+		if (cmd->count < 0 ||
+			!in_ensure(in, size + width * (size_t)cmd->count)) {
+			fprintf(stderr, "Truncated trace record\n");
+			return 0;
+		}
+		command_reserve(cmd, cmd->count);
+		p = in->data + in->pos + size;
+		for (int i = 0; i < cmd->count; i++)
+			cmd->addresses[i] = next_wide(&p, width);
+		size = size + width * (size_t)cmd->count;
+		break;
+	case CMD_STATS:
+		cmd->json = next_u32(&p) != 0;
+		break;
+	case CMD_SAVE_SNAPSHOT:
+	case CMD_LOAD_SNAPSHOT:
+		if (!decode_string(in, cmd, &p, &size))
+			return 0;
+		break;
+	}
+	in->pos = in->pos + size;
+	return 1;
+}
+
+// scrie comanda in formatul binar
+void encode_command(out_buf_t *out, command_t *cmd)
+{
+	out_char(out, cmd->type);
+	switch (cmd->type) {
+	case CMD_INIT_HEAP:
+		put_u64(out, cmd->address);
+		put_u32(out, cmd->nr_lists);
+		put_u64(out, cmd->nr_bytes);
+		put_u32(out, cmd->heap_type);
+		put_u32(out, cmd->policy);
+		put_u64(out, cmd->huge_threshold);
+		put_u64(out, cmd->huge_bytes);
+		break;
+	case CMD_MALLOC:
+		put_u64(out, cmd->nr_bytes);
+		break;
+	case CMD_FREE:
+		put_u64(out, cmd->address);
+		break;
+	case CMD_READ:
+		put_u64(out, cmd->address);
+		put_u64(out, cmd->nr_bytes);
+		break;
+	case CMD_WRITE:
+		put_u64(out, cmd->address);
+		put_u64(out, cmd->nr_bytes);
+		put_u32(out, cmd->length);
+		out_bytes(out, cmd->string, cmd->length);
+		break;
+	case CMD_MALLOC_N:
+		put_u64(out, cmd->nr_bytes);
+		put_u32(out, cmd->count);
+		break;
+	case CMD_FREE_N:
+		put_u32(out, cmd->count);
+		for (int i = 0; i < cmd->count; i++)
+			put_u64(out, cmd->addresses[i]);
+		break;
+	case CMD_STATS:
+		put_u32(out, cmd->json);
+		break;
+	case CMD_SAVE_SNAPSHOT:
+	case CMD_LOAD_SNAPSHOT:
+		put_u32(out, cmd->length);
+		out_bytes(out, cmd->string, cmd->length);
+		break;
+	}
+}
+
+// scrie comanda ca linie de text, in forma in care o citeste parse_command
+void print_command(out_buf_t *out, command_t *cmd)
+{
+	switch (cmd->type) {
+	case CMD_INIT_HEAP:
+		out_str(out, "INIT_HEAP ");
+		out_hex(out, cmd->address);
+		out_char(out, ' ');
+		out_dec(out, cmd->nr_lists);
+		out_char(out, ' ');
+		out_dec(out, cmd->nr_bytes);
+		out_char(out, ' ');
+		out_dec(out, cmd->heap_type);
+		if (cmd->policy != POLICY_BEST) {
+			out_char(out, ' ');
+			out_str(out, policy_names[cmd->policy]);
+		}
+		if (cmd->huge_bytes) {
+			out_str(out, " huge ");
+			out_dec(out, cmd->huge_threshold);
+			out_char(out, ' ');
+			out_dec(out, cmd->huge_bytes);
+		}
+		break;
+	case CMD_MALLOC:
+		out_str(out, "MALLOC ");
+		out_dec(out, cmd->nr_bytes);
+		break;
+	case CMD_FREE:
+		out_str(out, "FREE ");
+		out_hex(out, cmd->address);
+		break;
+	case CMD_READ:
+		out_str(out, "READ ");
+		out_hex(out, cmd->address);
+		out_char(out, ' ');
+		out_dec(out, cmd->nr_bytes);
+		break;
+	case CMD_WRITE:
+		out_str(out, "WRITE ");
+		out_hex(out, cmd->address);
+		out_str(out, " \"");
+		out_bytes(out, cmd->string, cmd->length);
+		out_str(out, "\" ");
+		out_dec(out, cmd->nr_bytes);
+		break;
+	case CMD_DUMP_MEMORY:
+		out_str(out, "DUMP_MEMORY");
+		break;
+	case CMD_DUMP_DELTA:
+		out_str(out, "DUMP_DELTA");
+		break;
+	case CMD_DESTROY_HEAP:
+		out_str(out, "DESTROY_HEAP");
+		break;
+	case CMD_MALLOC_N:
+		out_str(out, "MALLOC_N ");
+		out_dec(out, cmd->nr_bytes);
+		out_char(out, ' ');
+		out_dec(out, cmd->count);
+		break;
+	case CMD_FREE_N:
+		out_str(out, "FREE_N");
+		for (int i = 0; i < cmd->count; i++) {
+			out_char(out, ' ');
+			out_hex(out, cmd->addresses[i]);
+		}
+		break;
+	case CMD_STATS:
+		out_str(out, cmd->json ? "STATS json" : "STATS");
+		break;
+	case CMD_SAVE_SNAPSHOT:
+	case CMD_LOAD_SNAPSHOT:
+		out_str(out, cmd->type == CMD_SAVE_SNAPSHOT ? "SAVE_SNAPSHOT "
+													 : "LOAD_SNAPSHOT ");
+		out_bytes(out, cmd->string, cmd->length);
+		break;
+	}
+	out_char(out, '\n');
+}
+
+// urmatoarea comanda, din text sau din trace-ul binar; 0 la sfarsit
+int next_command(in_buf_t *in, command_t *cmd)
+{
+	if (in->binary)
+		return decode_command(in, cmd);
+
+	char *line, *end = NULL;
+	line = in_line(in, &end);
+	if (!line)
+		return 0;
+	parse_command(line, end, cmd);
+	return 1;
+}
+
+/*
+	returneaza zona continua de blocuri alocate care contine octetii
+	[address, address + nr_bytes), sau NULL daca nu exista sau nr_bytes e
+	negativ; e zona cu cea mai mare adresa de inceput care nu depaseste
+	address. Lungimea se compara cu ce ramane din zona, ca adunarea sa nu
+	poata depasi.
+*/
+dll_node_t *continuos_area(sfl *heap, sfl_addr_t nr_bytes, sfl_addr_t address)
+{
+	if (nr_bytes < 0)
+		return NULL;
+	tree_node_t *found = tree_floor(heap->runs->index, address);
+	if (!found)
+		return NULL;
+	dll_node_t *run = found->node;
+	sfl_addr_t end = run->data.address + run->data.dimension;
+	if (address > end || nr_bytes > end - address)
+		return NULL;
+	return run;
+}
+
+// returneaza locul din arena unde se afla octetul de la adresa address
+char *arena_at(sfl *heap, sfl_addr_t address)
+{
+	return heap->arena + (address - heap->regions[0]);
+}
+
+/*
+	functie pentru comanda write: scrie cei n octeti din buf in blocurile
+	alocate care incep de la adresa address; zona fiind verificata, toti
+	octetii se copiaza dintr-o data in arena
+*/
+int sfl_write(sfl *heap, sfl_addr_t address, const char *buf, sfl_addr_t n)
+{
+	// verificam daca e o adresa continua de memorie
+	if (!continuos_area(heap, n, address))
+		return SFL_SEGFAULT;
+	memcpy(arena_at(heap, address), buf, n);
+	return SFL_OK;
+}
+
+/*
+	functie pentru comanda read: copiaza n octeti din blocurile alocate care
+	incep de la adresa address direct din arena in buf; cu buf NULL doar
+	verifica zona
+*/
+int sfl_read(sfl *heap, sfl_addr_t address, char *buf, sfl_addr_t n)
+{
+	// verificam daca e o adresa continua de memorie
+	if (!continuos_area(heap, n, address))
+		return SFL_SEGFAULT;
+	if (buf)
+		memcpy(buf, arena_at(heap, address), n);
+	return SFL_OK;
+}
+
+// functie care elibereaza memoria pentru structurile de date alocate
+void sfl_destroy(sfl *heap)
+{
+	// eliberam si listele goale pastrate pentru refolosire
+	for (int i = 0; i < heap->max_lists; i++)
+		if (heap->memory[i])
+			ll_free(&heap->memory[i]);
+
+	free(heap->capacity);
+	free(heap->memory);
+	free(heap->nonempty);
+	free(heap->regions);
+	if (heap->arena)
+		munmap(heap->arena, heap->arena_size);
+	ll_free(&heap->mem_alloc);
+	ll_free(&heap->runs);
+	ll_free(&heap->extents);
+	// nodurile listelor si ale arborilor se elibereaza slab cu slab
+	pool_destroy(&heap->nodes);
+	pool_destroy(&heap->tree_nodes);
+	free(heap->changes);
+	free(heap);
+}
+
+#define SNAPSHOT_MAGIC "SFLS"
+#define SNAPSHOT_VERSION 4
+/*
+	cel mai mare contor acceptat dintr-un snapshot, ca sumele celor
+	STATS_CLASSES clase si incrementarile lor sa nu depaseasca
+*/
+#define SNAPSHOT_MAX_COUNT (1LL << 56)
+
+// numele fisierului temporar, path urmat de ".tmp"
+static char *snapshot_tmp_name(const char *path)
+{
+	char *name = malloc(strlen(path) + 5);
+	DIE(!name, "malloc failed...");
+	strcpy(name, path);
+	strcat(name, ".tmp");
+	return name;
+}
+
+// cati octeti are un snapshot pana la continutul arenei
+static long long snapshot_meta(snapshot_header_t *h)
+{
+	return sizeof(*h) + (h->nr_regions + 1LL) * sizeof(sfl_addr_t) +
+		   h->nr_lists * (sizeof(sfl_addr_t) + sizeof(snapshot_list_t)) +
+		   h->free_blocks * sizeof(sfl_addr_t) +
+		   (h->allocated + h->extents) * sizeof(info);
+}
+
+// 1 daca cei n octeti de la p sunt toti 0
+static int zero_bytes(const char *p, size_t n)
+{
+	return p[0] == 0 && memcmp(p, p + 1, n - 1) == 0;
+}
+
+/*
+	Scrie arena de la pozitia offset a fisierului. Paginile cu zerouri se
+	sar, iar ftruncate le lasa goluri in fisier, asa ca un heap mare si
+	putin folosit da un fisier mic. Returneaza -1 daca scrierea esueaza.
+*/
+static int save_arena(sfl *heap, int fd, long long offset, size_t page)
+{
+	size_t pos = 0, size = heap->arena_size;
+	while (pos < size) {
+		size_t n = size - pos < page ? size - pos : page;
+		if (zero_bytes(heap->arena + pos, n)) {
+			pos = pos + n;
+			continue;
+		}
+		size_t start = pos;
+		while (pos < size) {
+			n = size - pos < page ? size - pos : page;
+			if (zero_bytes(heap->arena + pos, n))
 				break;
+			pos = pos + n;
+		}
+		if (lseek(fd, offset + start, SEEK_SET) < 0 ||
+			try_write(fd, heap->arena + start, pos - start) < 0)
+			return -1;
+	}
+	return ftruncate(fd, offset + size);
+}
+
+// sink-ul snapshot-ului: o scriere esuata se tine minte in sink_data
+static void snapshot_sink(out_buf_t *out)
+{
+	if (try_write(out->fd, out->data, out->len) < 0)
+		*(int *)out->sink_data = 1;
+}
+
+/*
+	SAVE_SNAPSHOT: scrie starea heap-ului in formatul din snapshot_header_t.
+	Fisierul se scrie alaturi si se redenumeste la sfarsit, pentru ca arena
+	poate fi chiar mapata din fisierul vechi. Daca o scriere esueaza,
+	fisierul temporar se sterge si snapshot-ul vechi ramane neatins.
+*/
+int sfl_save_snapshot(sfl *heap, const char *path)
+{
+	char *tmp = snapshot_tmp_name(path);
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {	// directorul lipseste sau nu se poate scrie in el
+		free(tmp);
+		return SFL_IO_ERROR;
+	}
+
+	snapshot_header_t h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SNAPSHOT_MAGIC, 4);
+	h.version = SNAPSHOT_VERSION;
+	h.address = heap->regions[0];
+	h.nr_bytes = heap->nr_bytes;
+	h.rover = heap->rover;
+	h.nr_lists = heap->nr_lists;
+	h.nr_regions = heap->nr_regions;
+	h.type = heap->type;
+	h.policy = heap->policy;
+	for (int i = 0; i < heap->nr_lists; i++)
+		h.free_blocks = h.free_blocks + heap->memory[i]->size;
+	h.allocated = heap->mem_alloc->size;
+	h.extents = heap->extents->size;
+	h.huge_threshold = heap->huge_threshold;
+	h.huge_start = heap->huge_start;
+	h.huge_end = heap->huge_end;
+	size_t page = sysconf(_SC_PAGESIZE);
+	h.arena_offset = (snapshot_meta(&h) + page - 1) / page * page;
+	h.arena_size = heap->arena_size;
+	h.total_memory = heap->total_memory;
+	h.stats = heap->stats;
+
+	int failed = 0;
+	out_buf_t out;
+	out_init(&out);
+	out.fd = fd;
+	out.sink = snapshot_sink;
+	out.sink_data = &failed;
+	out_bytes(&out, (char *)&h, sizeof(h));
+	out_bytes(&out, (char *)heap->regions,
+			  (heap->nr_regions + 1) * sizeof(*heap->regions));
+	out_bytes(&out, (char *)heap->capacity,
+			  heap->nr_lists * sizeof(*heap->capacity));
+	for (int i = 0; i < heap->nr_lists; i++) {
+		dl_list_t *list = heap->memory[i];
+		snapshot_list_t l = {list->lazy_address, list->lazy_count, list->size};
+		out_bytes(&out, (char *)&l, sizeof(l));
+	}
+	for (int i = 0; i < heap->nr_lists; i++) {
+		dl_list_t *list = heap->memory[i];
+		dll_node_t *node = list->head;
+		for (int j = 0; j < list->size; j++) {
+			// distantele sunt in ordine descrescatoare
+			sfl_addr_t address = node ? node->data.address
+							: offset_address(heap, list, list->size - 1 - j);
+			out_bytes(&out, (char *)&address, sizeof(address));
+			if (node)
+				node = node->next;
+		}
+	}
+	for (dll_node_t *node = heap->mem_alloc->head; node; node = node->next)
+		out_bytes(&out, (char *)&node->data, sizeof(node->data));
+	for (dll_node_t *node = heap->extents->head; node; node = node->next)
+		out_bytes(&out, (char *)&node->data, sizeof(node->data));
+	out_flush(&out);
+	free(out.data);
+
+	if (!failed)
+		failed = save_arena(heap, fd, h.arena_offset, page) < 0;
+	if (close(fd) < 0)
+		failed = 1;
+	if (!failed && rename(tmp, path) < 0)
+		failed = 1;
+	if (failed)
+		unlink(tmp);
+	free(tmp);
+	return failed ? SFL_IO_ERROR : SFL_OK;
+}
+
+/*
+	Scade din *left octetii a count elemente de size octeti; 0 daca nu
+	incap, fara ca inmultirea sa poata depasi.
+*/
+static int snapshot_take(long long *left, long long count, size_t size)
+{
+	if (count < 0 || count > *left / (long long)size)
+		return 0;
+	*left = *left - count * (long long)size;
+	return 1;
+}
+
+// 1 daca blocul [address, address + dimension) e in [start, end)
+static int block_inside(sfl_addr_t address, sfl_addr_t dimension,
+						sfl_addr_t start, sfl_addr_t end)
+{
+	return dimension > 0 && address >= start && address < end &&
+		   dimension <= end - address;
+}
+
+/*
+	1 daca cele n blocuri sunt in ordinea adreselor, nu se suprapun si sunt
+	toate in zona listelor sau in zona alocarilor mari.
+*/
+static int blocks_valid(snapshot_header_t *h, sfl_addr_t *regions,
+						info *blocks, long long n)
+{
+	sfl_addr_t end = regions[0];
+	for (long long i = 0; i < n; i++) {
+		if (blocks[i].address < end ||
+			(!block_inside(blocks[i].address, blocks[i].dimension,
+						   regions[0], regions[h->nr_regions]) &&
+			 !block_inside(blocks[i].address, blocks[i].dimension,
+						   h->huge_start, h->huge_end)))
+			return 0;
+		end = blocks[i].address + blocks[i].dimension;
+	}
+	return 1;
+}
+
+/*
+	1 daca listele libere se pot copia: dimensiunile crescatoare, iar
+	blocurile fiecarei liste (si cele fara noduri) in zona listelor, in
+	ordinea adreselor si fara sa se suprapuna, cu free_blocks adrese in
+	total.
+*/
+static int lists_valid(snapshot_header_t *h, sfl_addr_t *regions)
+{
+	sfl_addr_t start = regions[0], end = regions[h->nr_regions];
+	sfl_addr_t *capacity = regions + h->nr_regions + 1;
+	snapshot_list_t *lists = (snapshot_list_t *)(capacity + h->nr_lists);
+	sfl_addr_t *blocks = (sfl_addr_t *)(lists + h->nr_lists);
+	long long left = h->free_blocks;
+	for (int i = 0; i < h->nr_lists; i++) {
+		sfl_addr_t dim = capacity[i];
+		snapshot_list_t *l = &lists[i];
+		if (dim <= (i ? capacity[i - 1] : 0) || l->size < 0 ||
+			l->size > left || l->size > INT_MAX || l->lazy_count < 0)
+			return 0;
+		if (l->lazy_count &&
+			(!block_inside(l->lazy_address, dim, start, end) ||
+			 l->lazy_count > (end - l->lazy_address) / dim))
+			return 0;
+		sfl_addr_t next = start;
+		for (sfl_addr_t j = 0; j < l->size; j++) {
+			if (blocks[j] < next || !block_inside(blocks[j], dim, start, end))
+				return 0;
+			next = blocks[j] + dim;
+		}
+		blocks = blocks + l->size;
+		left = left - l->size;
+	}
+	return left == 0;
+}
+
+/*
+	1 daca fisierul de size octeti e un snapshot care se poate incarca fara
+	sa se citeasca sau sa se scrie in afara lui sau a arenei: antetul, apoi
+	zonele si listele, apoi fiecare bloc liber, alocat sau extindere fata de
+	zonele heap-ului. Marimile se aduna verificand depasirile, iar
+	contoarele statisticilor trebuie sa fie intre 0 si SNAPSHOT_MAX_COUNT.
+*/
+static int snapshot_valid(snapshot_header_t *h, long long size)
+{
+	long long page = sysconf(_SC_PAGESIZE), left;
+	if (size < (long long)sizeof(*h) || memcmp(h->magic, SNAPSHOT_MAGIC, 4) ||
+		h->version != SNAPSHOT_VERSION)
+		return 0;
+	// block_origin calculeaza 8 << zona, care trebuie sa incapa
+	if (h->nr_lists < 0 || h->nr_regions < 0 || h->nr_regions > 60 ||
+		h->type < 0 || h->type > 2 || h->policy < POLICY_BEST ||
+		h->policy > POLICY_TLSF || h->allocated > INT_MAX ||
+		h->extents > INT_MAX || h->arena_size < 0 || h->arena_offset < 0 ||
+		h->arena_offset % page || h->arena_offset > size ||
+		h->arena_size > size - h->arena_offset)
+		return 0;
+	left = h->arena_offset;
+	if (!snapshot_take(&left, 1, sizeof(*h)) ||
+		!snapshot_take(&left, h->nr_regions + 1LL, sizeof(sfl_addr_t)) ||
+		!snapshot_take(&left, h->nr_lists,
+					   sizeof(sfl_addr_t) + sizeof(snapshot_list_t)) ||
+		!snapshot_take(&left, h->free_blocks, sizeof(sfl_addr_t)) ||
+		!snapshot_take(&left, h->allocated, sizeof(info)) ||
+		!snapshot_take(&left, h->extents, sizeof(info)))
+		return 0;
+
+	// zonele crescatoare de la address, apoi zona alocarilor mari
+	sfl_addr_t *regions = (sfl_addr_t *)(h + 1);
+	if (h->address < 0 || regions[0] != h->address)
+		return 0;
+	for (int i = 0; i < h->nr_regions; i++)
+		if (regions[i + 1] < regions[i])
+			return 0;
+	if (h->huge_start < regions[h->nr_regions] ||
+		h->huge_end < h->huge_start ||
+		h->arena_size != h->huge_end - regions[0])
+		return 0;
+	if (!lists_valid(h, regions))
+		return 0;
+
+	long long *counts = (long long *)&h->stats;
+	for (size_t i = 0; i < sizeof(h->stats) / sizeof(*counts); i++)
+		if (counts[i] < 0 || counts[i] > SNAPSHOT_MAX_COUNT)
+			return 0;
+	if (h->total_memory < 0 || h->total_memory > SNAPSHOT_MAX_COUNT)
+		return 0;
+
+	sfl_addr_t *capacity = regions + h->nr_regions + 1;
+	snapshot_list_t *lists = (snapshot_list_t *)(capacity + h->nr_lists);
+	info *allocated = (info *)((sfl_addr_t *)(lists + h->nr_lists) +
+							   h->free_blocks);
+	info *extents = allocated + h->allocated;
+	if (!blocks_valid(h, regions, allocated, h->allocated))
+		return 0;
+	sfl_addr_t end = h->huge_start;
+	for (long long i = 0; i < h->extents; i++) {
+		if (extents[i].address < end ||
+			!block_inside(extents[i].address, extents[i].dimension,
+						  h->huge_start, h->huge_end))
+			return 0;
+		end = extents[i].address + extents[i].dimension;
+	}
+	return 1;
+}
+
+/*
+	Blocurile alocate, in ordinea adreselor: nodurile se adauga la sfarsitul
+	listei, iar blocurile lipite intre ele intra deodata in zonele continue.
+*/
+static void load_allocated(sfl *heap, info *blocks, long long n)
+{
+	dl_list_t *mem_alloc = heap->mem_alloc;
+	dll_node_t *prev = NULL;
+	for (long long i = 0; i < n; i++) {
+		prev = dll_add_after(mem_alloc, prev, &blocks[i]);
+		tree_insert(&heap->tree_nodes, &mem_alloc->index, blocks[i].address,
+					prev);
+	}
+	for (long long i = 0, j; i < n; i = j) {
+		sfl_addr_t end = blocks[i].address + blocks[i].dimension;
+		for (j = i + 1; j < n && blocks[j].address == end; j++)
+			end = end + blocks[j].dimension;
+		run_add(heap, blocks[i].address, end - blocks[i].address);
+	}
+}
+
+/*
+	LOAD_SNAPSHOT: fisierul se mapeaza in memorie si vectorii lui se copiaza
+	direct in liste, fara nicio conversie. Arena se mapeaza privat din
+	fisier, asa ca nu se citeste nimic din ea pana nu se folosesc paginile,
+	iar scrierile nu ajung in fisier.
+*/
+sfl *sfl_load_snapshot(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	char *data = NULL;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+		st.st_size >= (off_t)sizeof(snapshot_header_t)) {
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+			data = NULL;
+	}
+	snapshot_header_t *h = (snapshot_header_t *)data;
+	if (!data || !snapshot_valid(h, st.st_size)) {
+		if (data)
+			munmap(data, st.st_size);
+		close(fd);
+		return NULL;
+	}
+
+	sfl *heap = malloc(sizeof(*heap));
+	DIE(!heap, "malloc failed...");
+	heap->address = h->address;
+	heap->nr_bytes = h->nr_bytes;
+	heap->nr_lists = h->nr_lists;
+	heap->nr_regions = h->nr_regions;
+	heap->type = h->type;
+	heap->policy = h->policy;
+	heap_init(heap);
+	heap->rover = h->rover;
+	sfl_addr_t *regions = (sfl_addr_t *)(h + 1);
+	memcpy(heap->regions, regions, (h->nr_regions + 1) * sizeof(*regions));
+	sfl_addr_t *capacity = regions + h->nr_regions + 1;
+	memcpy(heap->capacity, capacity, h->nr_lists * sizeof(*capacity));
+	heap_set_compact(heap);
+
+	snapshot_list_t *lists = (snapshot_list_t *)(capacity + h->nr_lists);
+	sfl_addr_t *blocks = (sfl_addr_t *)(lists + h->nr_lists);
+	for (int i = 0; i < h->nr_lists; i++) {
+		dl_list_t *list = dll_create(&heap->nodes);
+		heap->memory[i] = list;
+		list->lazy_address = lists[i].lazy_address;
+		list->lazy_count = lists[i].lazy_count;
+		int n = lists[i].size;
+		if (heap->compact && n) {
+			list->max_offsets = MIN_OFFSETS;
+			while (list->max_offsets < n)
+				list->max_offsets = 2 * list->max_offsets;
+			list->offsets = malloc(list->max_offsets * sizeof(sfl_offset_t));
+			DIE(!list->offsets, "malloc failed...");
+			for (int j = 0; j < n; j++)
+				list->offsets[n - 1 - j] = blocks[j] - heap->regions[0];
+			list->size = n;
+		} else {
+			dll_node_t *prev = NULL;
+			for (int j = 0; j < n; j++) {
+				info block = {blocks[j], heap->capacity[i]};
+				prev = dll_add_after(list, prev, &block);
+				tree_node_t **tree = free_tree(heap, list);
+				if (tree)
+					tree_insert(&heap->tree_nodes, tree, blocks[j], prev);
 			}
-		} else if (strcmp(command, "DUMP_MEMORY") == 0) {
-			dump_print(heap, mem_alloc, total_memory, malloc_calls,
-					   nr_fragmentation, free_calls);
-		} else if (strcmp(command, "DESTROY_HEAP") == 0) {
-			break;
 		}
-		scanf("%s", command);
+		blocks = blocks + n;
+	}
+	rebuild_bitmap(heap);
+	load_allocated(heap, (info *)blocks, h->allocated);
+	// extinderile libere, la sfarsitul listei lor; statisticile vin din antet
+	info *extents = (info *)blocks + h->allocated;
+	dll_node_t *prev = NULL;
+	for (long long i = 0; i < h->extents; i++) {
+		prev = dll_add_after(heap->extents, prev, &extents[i]);
+		tree_insert(&heap->tree_nodes, &heap->extents->index,
+					extents[i].address, prev);
+	}
+	heap->huge_threshold = h->huge_threshold;
+	heap->huge_start = h->huge_start;
+	heap->huge_end = h->huge_end;
+
+	heap->arena_size = h->arena_size;
+	heap->arena = NULL;
+	if (heap->arena_size) {
+		heap->arena = mmap(NULL, heap->arena_size, PROT_READ | PROT_WRITE,
+						   MAP_PRIVATE | MAP_NORESERVE, fd, h->arena_offset);
+		if (heap->arena == MAP_FAILED)
+			heap->arena = NULL;
 	}
-	// eliberam memoria
-	free_the_sfl(heap, mem_alloc);
-	free(command);
+	heap->stats = h->stats;
+	heap->total_memory = h->total_memory;
+	munmap(data, st.st_size);
+	close(fd);
+	if (heap->arena_size && !heap->arena) {
+		sfl_destroy(heap);
+		return NULL;
+	}
+	return heap;
+}
 
-	return 0;
+/*
+	Citeste toate comenzile fara sa le execute si afiseaza cate sunt; se
+	foloseste pentru a masura separat viteza citirii.
+*/
+void parse_only(in_buf_t *in)
+{
+	command_t cmd;
+	long long nr_commands = 0;
+	command_init(&cmd);
+	while (next_command(in, &cmd)) {
+		if (cmd.type != CMD_NONE)
+			nr_commands++;
+	}
+	command_free(&cmd);
+	printf("%lld commands\n", nr_commands);
+}
+
+/*
+	Converteste comenzile de la intrare din text in trace binar sau, daca
+	intrarea e binara, din trace binar in text. Liniile care nu sunt comenzi
+	nu se pastreaza.
+*/
+void convert_trace(in_buf_t *in)
+{
+	out_buf_t out;
+	command_t cmd;
+	out_init(&out);
+	command_init(&cmd);
+	if (!in->binary) {
+		out_str(&out, TRACE_MAGIC);
+		put_u32(&out, TRACE_VERSION);
+	}
+	while (next_command(in, &cmd)) {
+		if (cmd.type == CMD_NONE)
+			continue;
+		if (in->binary)
+			print_command(&out, &cmd);
+		else
+			encode_command(&out, &cmd);
+	}
+	out_flush(&out);
+	free(out.data);
+	command_free(&cmd);
 }
@@ -0,0 +1,343 @@
+#ifndef SFL_H
+#define SFL_H
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sfl_lib.h"
+
+#define DIE(assertion, call_description)					\
+do {														\
+	if (assertion) {										\
+		fprintf(stderr, "(%s, %d): ", __FILE__, __LINE__);	\
+		perror(call_description);							\
+		exit(errno);										\
+	}														\
+} while (0)
+
+/*
+	Distanta unui bloc liber fata de inceputul heap-ului, in listele fara
+	noduri. Pe 32 de biti costa jumatate; un heap mai mare de 4 GiB foloseste
+	atunci noduri, daca nu se compileaza cu SFL_WIDE_OFFSETS.
+*/
+#ifdef SFL_WIDE_OFFSETS
+typedef unsigned long long sfl_offset_t;
+#else
+typedef unsigned int sfl_offset_t;
+#endif
+
+typedef struct info {
+	sfl_addr_t address;	// adresa de inceput al unui bloc de memorie
+	sfl_addr_t dimension;	// dimensiune blocului de memorie
+} info;
+
+typedef struct dll_node_t {
+	info data;	// datele blocului, retinute direct in nod
+	struct dll_node_t *prev, *next;
+} dll_node_t;
+
+/*
+	Zona din care se aloca elemente de aceeasi dimensiune (noduri de lista sau
+	de arbore). Elementele sunt luate din blocuri mari (slab-uri), iar cele
+	eliberate sunt refolosite la urmatoarele alocari.
+*/
+typedef struct pool_t {
+	void *free_items;	// elementele eliberate, inlantuite intre ele
+	char **slabs;
+	int nr_slabs;
+	int max_slabs;
+	int used;	// cate elemente s-au dat din ultimul slab
+	int item_size;
+} pool_t;
+
+#define SLAB_ITEMS 1024
+
+// nod din arborele de cautare dupa adresa (treap)
+typedef struct tree_node_t {
+	sfl_addr_t key;	// adresa blocului de memorie
+	unsigned int priority;
+	dll_node_t *node;	// nodul din lista care are adresa key
+	sfl_addr_t max_dimension;	// cel mai mare bloc din subarbore
+	struct tree_node_t *left, *right;
+} tree_node_t;
+
+typedef struct dl_list_t {
+	dll_node_t *head;
+	pool_t *pool;	// zona din care se aloca nodurile listei
+	int size;
+	// blocuri libere consecutive pentru care inca nu s-au creat noduri
+	sfl_addr_t lazy_address;	// adresa primului dintre ele
+	sfl_addr_t lazy_count;	// cate sunt
+
+	tree_node_t *index;	// nodurile listei ordonate dupa adresa, sau NULL
+	sfl_addr_t counted;	// blocurile libere ale listei numarate in statistici
+
+	/*
+		Listele libere ale unui heap compact (fara arbore de adrese) nu au
+		noduri: adresele blocurilor se tin aici, ca distante fata de
+		inceputul heap-ului, in ordine descrescatoare, iar size e numarul lor.
+	*/
+	sfl_offset_t *offsets;
+	int max_offsets;
+} dl_list_t;
+
+/*
+	Buffer pentru afisare: comenzile pun aici textul, iar acesta ajunge la
+	iesire cu un singur apel write cand se umple sau cand se cere golirea lui.
+*/
+typedef struct out_buf_t {
+	char *data;
+	int len;
+	int fd;	// unde se scrie, implicit iesirea standard
+	int interactive;	// golim dupa fiecare comanda (intrare de la terminal)
+	/*
+		Daca nu e NULL, primeste bufferul plin in locul lui write si il
+		inlocuieste cu unul gol (--pipeline il da firului de afisare).
+	*/
+	void (*sink)(struct out_buf_t *out);
+	void *sink_data;
+} out_buf_t;
+
+#define OUT_SIZE (1 << 16)
+
+/*
+	Intrarea programului: fie fisierul mapat in memorie, fie un buffer mare
+	umplut cu read. O linie ramane intreaga in buffer cat timp se executa
+	comanda de pe ea, asa ca parametrii pot fi folositi direct din buffer.
+*/
+typedef struct in_buf_t {
+	char *data;
+	size_t len;	// cati octeti valizi sunt in buffer
+	size_t pos;	// unde incepe urmatoarea linie
+	size_t size;	// cati octeti are bufferul
+	int fd;
+	int eof;	// nu mai e nimic de citit dupa len
+	int mapped;	// data e fisierul mapat, nu un buffer alocat
+	int binary;	// comenzile sunt in formatul binar, nu text
+	int version;	// versiunea trace-ului binar
+} in_buf_t;
+
+#define IN_SIZE (1 << 20)
+
+enum command_type {
+	CMD_NONE,	// linie goala sau comanda necunoscuta
+	CMD_INIT_HEAP,
+	CMD_MALLOC,
+	CMD_FREE,
+	CMD_READ,
+	CMD_WRITE,
+	CMD_DUMP_MEMORY,
+	CMD_DESTROY_HEAP,
+	CMD_MALLOC_N,
+	CMD_FREE_N,
+	CMD_STATS,
+	CMD_SAVE_SNAPSHOT,
+	CMD_LOAD_SNAPSHOT,
+	CMD_DUMP_DELTA
+};
+
+#define CMD_TYPES (CMD_DUMP_DELTA + 1)
+
+/*
+	Clasele TLSF: primul nivel e puterea lui 2 a dimensiunii, iar al doilea
+	imparte fiecare putere in TLSF_SL intervale egale. Dimensiunile mai mici
+	decat TLSF_SL au fiecare clasa ei pe primul nivel 0.
+*/
+#define TLSF_SL_LOG 3
+#define TLSF_SL (1 << TLSF_SL_LOG)
+#define TLSF_FL (64 - TLSF_SL_LOG + 1)
+
+/*
+	Latentele comenzilor, tinute de programul care le executa, nu de heap,
+	ca sa ramana cand INIT_HEAP sau LOAD_SNAPSHOT schimba heap-ul. Se numara
+	in nanosecunde, pe clasele TLSF (histograma HDR cu 8 intervale pe
+	fiecare putere a lui 2). Citirea ceasului costa cat o comanda scurta, asa
+	ca se cronometreaza doar una din STATS_SAMPLE comenzi de acelasi tip.
+*/
+// latentele sunt pe cel mult 32 de biti, asa ca ajung clasele TLSF ale lor
+#define STATS_BUCKETS ((32 - TLSF_SL_LOG + 1) * TLSF_SL)
+#define STATS_SAMPLE 16
+
+typedef struct command_stats_t {
+	long long commands[CMD_TYPES];	// comenzile executate, dupa tip
+	long long timed[CMD_TYPES];	// cate dintre ele s-au cronometrat
+	long long latency_total[CMD_TYPES];
+	long long latency_max[CMD_TYPES];
+	long long latency[CMD_TYPES][STATS_BUCKETS];
+} command_stats_t;
+
+// o comanda citita, impreuna cu parametrii ei
+typedef struct command_t {
+	int type;
+	sfl_addr_t address;
+	int nr_lists;
+	sfl_addr_t nr_bytes;
+	int heap_type;
+	int policy;	// politica de plasare a lui INIT_HEAP
+	sfl_addr_t huge_threshold;	// "huge <prag> <octeti>" la INIT_HEAP
+	sfl_addr_t huge_bytes;	// 0 daca heap-ul nu are zona alocarilor mari
+	// sirul lui WRITE sau fisierul unui snapshot, direct din intrare
+	char *string;
+	int length;	// lungimea sirului
+	int count;	// cate blocuri aloca MALLOC_N sau elibereaza FREE_N
+	sfl_addr_t *addresses;	// adresele lui FREE_N
+	int max_addresses;	// cate adrese incap in addresses
+	int json;	// STATS afiseaza un obiect JSON
+} command_t;
+
+// cate blocuri aloca main deodata pentru MALLOC_N
+#define BATCH_SIZE 1024
+
+/*
+	O intrare din jurnalul lui DUMP_DELTA: blocul a aparut (+1) sau a
+	disparut (-1) din listele libere, din lista blocurilor alocate sau din
+	extinderile libere ale alocarilor mari.
+*/
+typedef struct change_t {
+	sfl_addr_t address;
+	sfl_addr_t dimension;
+	// 1 pentru blocurile alocate, 0 pentru cele libere, 2 pentru extinderi
+	int allocated;
+	int sign;
+} change_t;
+
+// heap-ul din spatele handle-ului din sfl_lib.h
+struct sfl {
+	int nr_lists;
+	sfl_addr_t address;
+	sfl_addr_t nr_bytes;
+	int type;
+	sfl_addr_t *capacity;	// numarul de bytes al blocurilor fiecarei liste
+	dl_list_t **memory;	// vectorul de liste
+	int max_lists;	// numarul de pozitii alocate in vectorul de liste
+	unsigned long long *nonempty;	// bitmap cu listele care au blocuri libere
+	int nr_regions;	// numarul de liste create la INIT_HEAP
+	sfl_addr_t *regions;	// adresele de inceput ale zonelor acestor liste
+	tree_node_t *free_index;	// blocurile libere dupa adresa, daca indexed
+	dl_list_t *runs;	// zonele continue maxime de blocuri alocate
+	int indexed;	// type 1, first-fit si next-fit folosesc free_index
+	int buddy;	// type 2: blocurile se injumatatesc si se reunesc cu buddy-ul
+	int compact;	// listele libere tin distante in loc de noduri
+	int policy;	// enum placement_policy
+	sfl_addr_t rover;	// next-fit: cautarea incepe de la aceasta adresa
+	sfl_addr_t next_block;	// next-fit: blocul ales de find_block
+	unsigned long long tlsf_first;	// primele niveluri cu clase nevide
+	unsigned int tlsf_second[TLSF_FL];	// clasele nevide ale fiecarui nivel
+	int tlsf_count[TLSF_FL][TLSF_SL];	// cate liste nevide are fiecare clasa
+	pool_t nodes;	// nodurile tuturor listelor
+	pool_t tree_nodes;	// nodurile arborilor de adrese
+	char *arena;	// continutul blocurilor, indexat dupa adresa
+	size_t arena_size;
+	dl_list_t *mem_alloc;	// blocurile alocate, dupa adresa
+	/*
+		Zona alocarilor mari, [huge_start, huge_end), dupa zonele listelor;
+		huge_end e egal cu huge_start daca heap-ul nu o are. Extinderile ei
+		libere se tin doar in extents, dupa adresa, si in arborele ei, asa ca
+		listele libere nu le vad niciodata.
+	*/
+	sfl_addr_t huge_threshold;
+	sfl_addr_t huge_start;
+	sfl_addr_t huge_end;
+	dl_list_t *extents;
+	long long total_memory;	// nr_lists * nr_bytes de la INIT_HEAP
+	sfl_stats_t stats;
+	// schimbarile de la ultimul dump, tinute doar dupa primul DUMP_DELTA
+	int logging;
+	change_t *changes;
+	long long nr_changes;
+	long long max_changes;
+};
+
+/*
+	Antetul unui snapshot scris de SAVE_SNAPSHOT. Fisierul nu contine
+	pointeri, doar numere in ordinea octetilor masinii, asa ca se poate
+	mapa oriunde. Dupa antet urmeaza inceputurile zonelor initiale
+	(nr_regions + 1), dimensiunile listelor, cate un snapshot_list_t pentru
+	fiecare lista, adresele blocurilor libere ale listelor, la rand si in
+	ordine crescatoare, blocurile alocate si extinderile libere, ca info,
+	tot in ordinea adreselor. Continutul arenei incepe la arena_offset, la
+	o granita de pagina, ca LOAD_SNAPSHOT sa il mapeze direct din fisier;
+	paginile cu zerouri raman goluri in fisier.
+*/
+typedef struct snapshot_header_t {
+	char magic[4];
+	unsigned int version;
+	sfl_addr_t address;
+	sfl_addr_t nr_bytes;
+	sfl_addr_t rover;
+	int nr_lists;
+	int nr_regions;
+	int type;
+	int policy;
+	long long free_blocks;	// cate adrese de blocuri libere urmeaza
+	long long allocated;	// cate blocuri alocate urmeaza
+	long long extents;	// cate extinderi libere urmeaza
+	sfl_addr_t huge_threshold;
+	sfl_addr_t huge_start;
+	sfl_addr_t huge_end;
+	long long arena_offset;
+	long long arena_size;
+	long long total_memory;
+	sfl_stats_t stats;
+} snapshot_header_t;
+
+// o lista libera din snapshot; adresele ei sunt in continuarea celorlalte
+typedef struct snapshot_list_t {
+	sfl_addr_t lazy_address;
+	sfl_addr_t lazy_count;
+	sfl_addr_t size;	// cate blocuri cu adresa are
+} snapshot_list_t;
+
+// INIT_HEAP creeaza vectorul de liste, iar dll_create lista alocata
+dl_list_t **create_list_vector(sfl *heap);
+dl_list_t *dll_create(pool_t *pool);
+
+// continutul blocurilor alocate
+dll_node_t *continuos_area(sfl *heap, sfl_addr_t nr_bytes, sfl_addr_t address);
+char *arena_at(sfl *heap, sfl_addr_t address);
+
+// starea heap-ului
+double fragmentation_ratio(sfl *heap);
+long long free_bytes_from(sfl *heap, sfl_addr_t dimension);
+long long free_list_bytes(sfl *heap);
+
+/*
+	DUMP_MEMORY, DUMP_DELTA si STATS (ca text sau ca un obiect JSON pe o
+	linie), in out; STATS merge si fara heap (NULL), cu contoarele lui la
+	zero.
+*/
+void dump_print(out_buf_t *out, sfl *heap);
+void delta_print(out_buf_t *out, sfl *heap);
+void stats_print(out_buf_t *out, sfl *heap, command_stats_t *commands);
+void stats_print_json(out_buf_t *out, sfl *heap, command_stats_t *commands);
+// numara o comanda de tipul type; returneaza 1 daca trebuie cronometrata
+int stats_sample(command_stats_t *stats, int type);
+// adauga durata in ns a unei comenzi cronometrate in histograma tipului ei
+void stats_latency(command_stats_t *stats, int type, long long ns);
+
+// bufferul de afisare
+void out_init(out_buf_t *out);
+void out_flush(out_buf_t *out);
+void write_all(int fd, const char *s, size_t n);
+void out_bytes(out_buf_t *out, const char *s, size_t n);
+void out_str(out_buf_t *out, const char *s);
+void out_char(out_buf_t *out, char c);
+
+/*
+	Citirea comenzilor, ca text sau ca trace binar; trace_header verifica
+	antetul unui trace binar (0 daca nu e valid), iar next_command
+	returneaza 0 la sfarsitul intrarii.
+*/
+void in_init(in_buf_t *in, int fd);
+void in_free(in_buf_t *in);
+int trace_header(in_buf_t *in);
+void command_init(command_t *cmd);
+void command_free(command_t *cmd);
+int next_command(in_buf_t *in, command_t *cmd);
+// --parse-only si --to-binary / --to-text
+void parse_only(in_buf_t *in);
+void convert_trace(in_buf_t *in);
+
+#endif
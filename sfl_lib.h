@@ -0,0 +1,144 @@
+#ifndef SFL_LIB_H
+#define SFL_LIB_H
+
+/*
+	Interfata publica a alocatorului. Un heap se foloseste doar prin
+	handle-ul intors de sfl_init, asa ca intr-un proces pot exista oricate
+	heap-uri independente. Functiile nu afiseaza nimic: erorile, inclusiv
+	un fisier care nu se poate citi sau scrie, se intorc ca valorile
+	negative din enum sfl_error, iar mesajele comenzilor le afiseaza
+	programul care le executa.
+*/
+
+/*
+	Adresele si dimensiunile heap-ului simulat sunt pe 64 de biti, ca un heap
+	sa poata avea mai multi terabytes.
+*/
+typedef long long sfl_addr_t;
+
+typedef struct sfl sfl;
+
+// cum alege MALLOC blocul liber, data optional la INIT_HEAP
+enum placement_policy {
+	POLICY_BEST,	// cea mai mica dimensiune suficienta, adresa cea mai mica
+	POLICY_FIRST,	// blocul suficient de mare cu cea mai mica adresa
+	POLICY_NEXT,	// primul bloc suficient de mare dupa ultima alocare
+	POLICY_TLSF	// clasa TLSF cu doua niveluri, gasita cu doua bitmap-uri
+};
+
+enum sfl_error {
+	SFL_OK = 0,
+	SFL_OUT_OF_MEMORY = -1,	// niciun bloc liber destul de mare
+	SFL_INVALID_FREE = -2,	// adresa nu e inceputul unui bloc alocat
+	SFL_SEGFAULT = -3,	// octetii nu sunt toti in blocuri alocate
+	SFL_IO_ERROR = -4	// fisierul unui snapshot nu s-a putut folosi
+};
+
+/*
+	Statisticile heap-ului, tinute la zi de fiecare operatie, ca sa fie
+	citite fara sa se parcurga listele. Clasa k de dimensiuni (sau de lungimi
+	de liste) are valorile de la 2^k la 2^(k+1) - 1.
+*/
+#define STATS_CLASSES 63
+
+typedef struct sfl_stats_t {
+	long long allocated_bytes;
+	long long requested_bytes;	// cat s-a cerut (mai putin in modul buddy)
+	long long allocated_blocks;
+	long long free_bytes;
+	long long free_blocks;
+	long long free_extent_bytes;	// in zona alocarilor mari
+	long long free_extents;
+	long long hits[STATS_CLASSES];	// MALLOC dintr-un bloc exact cat cererea
+	long long splits[STATS_CLASSES];	// MALLOC care a fragmentat blocul
+	long long misses[STATS_CLASSES];	// MALLOC fara bloc liber
+	long long frees;
+	long long invalid_frees;
+	long long merges;
+	long long list_lengths[STATS_CLASSES];	// listele nevide, dupa lungime
+	long long searches;	// cautarile unui bloc liber
+	// sonde binare, cuvinte din bitmap, liste si noduri de arbore verificate
+	long long search_steps;
+} sfl_stats_t;
+
+/*
+	INIT_HEAP: nr_lists liste de cate nr_bytes octeti, de la address; type 0
+	nu reuneste blocurile, type 1 le reuneste cu vecinii, type 2 e modul
+	buddy. policy e o valoare din enum placement_policy.
+*/
+sfl *sfl_init(sfl_addr_t address, int nr_lists, sfl_addr_t nr_bytes,
+			  int type, int policy);
+void sfl_destroy(sfl *heap);
+/*
+	Alocarile de peste threshold octeti nu mai trec prin liste: se iau,
+	rotunjite la SFL_PAGE octeti, dintr-o zona separata de nr_bytes octeti
+	aflata dupa listele heap-ului. Se apeleaza pe un heap nou, inainte de
+	prima alocare; fara apel, heap-ul nu are aceasta zona.
+*/
+#define SFL_PAGE 4096
+void sfl_huge_init(sfl *heap, sfl_addr_t threshold, sfl_addr_t nr_bytes);
+
+// adresa blocului alocat sau SFL_OUT_OF_MEMORY, si pentru size <= 0
+sfl_addr_t sfl_malloc(sfl *heap, sfl_addr_t size);
+// SFL_OK sau SFL_INVALID_FREE
+int sfl_free(sfl *heap, sfl_addr_t address);
+/*
+	Acelasi efect ca count apeluri sfl_malloc, respectiv sfl_free, la rand.
+	Adresele nealocate devin SFL_OUT_OF_MEMORY; returneaza cate blocuri s-au
+	alocat, respectiv eliberat.
+*/
+int sfl_malloc_n(sfl *heap, sfl_addr_t size, int count,
+				 sfl_addr_t *addresses);
+int sfl_free_n(sfl *heap, sfl_addr_t *addresses, int count);
+
+/*
+	Copiaza n octeti din, respectiv in, blocurile alocate de la address.
+	Returneaza SFL_SEGFAULT, fara sa copieze nimic, daca n e negativ sau
+	octetii nu sunt toti in blocuri alocate lipite intre ele. sfl_read cu buf
+	NULL doar verifica.
+*/
+int sfl_read(sfl *heap, sfl_addr_t address, char *buf, sfl_addr_t n);
+int sfl_write(sfl *heap, sfl_addr_t address, const char *buf, sfl_addr_t n);
+
+void sfl_stats(sfl *heap, sfl_stats_t *stats);
+
+/*
+	Tot heap-ul intr-un fisier si inapoi. sfl_save_snapshot returneaza SFL_OK
+	sau SFL_IO_ERROR daca fisierul nu se poate crea sau scrie, iar
+	sfl_load_snapshot un heap nou sau NULL daca fisierul lipseste sau nu e
+	un snapshot valid.
+*/
+int sfl_save_snapshot(sfl *heap, const char *path);
+sfl *sfl_load_snapshot(const char *path);
+
+// politica de plasare dupa nume ("best", "first", "next", "tlsf") sau -1
+int policy_by_name(const char *name, int len);
+
+/*
+	Heap folosit din mai multe fire de executie (sfl_mt.c). Zona INIT_HEAP se
+	imparte in nr_arenas arene, fiecare cu listele ei si cu lacatul ei, iar
+	fiecare fir pastreaza pana la cache_size blocuri eliberate din fiecare
+	clasa de dimensiune. Functiile returneaza -1 la eroare. Starea fiecarei
+	granule de 8 octeti se tine intr-un vector, asa ca acest heap ramane cu
+	adrese int.
+*/
+typedef struct sfl_mt_t sfl_mt_t;
+
+// cum isi tin arenele blocurile libere
+enum sfl_mt_lists {
+	SFL_MT_SORTED,	// listele sfl, ordonate dupa adresa, sub lacatul arenei
+	SFL_MT_STACKS	// cate o stiva fara lacat pe clasa (doar pentru type 0)
+};
+
+sfl_mt_t *sfl_mt_create(int address, int nr_lists, int nr_bytes, int type,
+						int lists, int nr_arenas, int cache_size);
+void sfl_mt_destroy(sfl_mt_t *mt);
+int sfl_mt_malloc(sfl_mt_t *mt, int size);
+int sfl_mt_free(sfl_mt_t *mt, int address);
+// returneaza cate blocuri s-au alocat, respectiv eliberat
+int sfl_mt_malloc_n(sfl_mt_t *mt, int size, int count, int *addresses);
+int sfl_mt_free_n(sfl_mt_t *mt, int *addresses, int count);
+int sfl_mt_read(sfl_mt_t *mt, int address, char *buf, int n);
+int sfl_mt_write(sfl_mt_t *mt, int address, const char *buf, int n);
+
+#endif
@@ -0,0 +1,612 @@
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sfl.h"
+
+/*
+	Heap-ul pentru mai multe fire de executie.
+
+	Zona de la INIT_HEAP se imparte in arene egale; fiecare arena e un heap
+	sfl obisnuit (aceleasi liste ca la create_list_vector, cu bytes impartiti
+	la numarul de arene), protejat de lacatul lui. Un fir de executie
+	foloseste mereu aceeasi arena si tine blocurile eliberate recent intr-un
+	cache propriu, cate unul pentru fiecare clasa de dimensiune, asa ca
+	majoritatea alocarilor si eliberarilor nu iau niciun lacat.
+
+	Dimensiunile se rotunjesc la clasa lor (8, 16, ..., cel mai mare bloc),
+	deci orice bloc alocat incepe la un multiplu de 8 fata de inceputul
+	zonei. Pentru fiecare astfel de pozitie, states retine daca acolo incepe
+	un bloc alocat si din ce clasa, ceea ce permite eliberarea fara cautare.
+
+	Un bloc eliberat de un fir care nu foloseste arena lui se pune pe o stiva
+	fara lacat a arenei (remote), legata prin primii 4 octeti ai blocurilor,
+	si este eliberat in arena de urmatorul fir care ia lacatul ei.
+
+	Cu SFL_MT_STACKS arenele nu mai folosesc listele sfl: fiecare clasa are o
+	stiva fara lacat (Treiber) de blocuri libere, legata tot prin primii 4
+	octeti ai blocurilor, iar blocurile inca neatinse se iau cu un contor, ca
+	blocurile fara noduri din create_list_vector. Cand o clasa nu mai are
+	blocuri, se imparte un bloc dintr-o clasa mai mare in bucati de 8 << k.
+	Blocurile nu se mai reunesc, asa ca ordinea dupa adresa nu mai e
+	necesara si modul e permis doar pentru type 0.
+*/
+
+#define IN_CACHE 0x80	// blocul e intr-un cache sau pe o stiva remote
+#define GRANULE 8
+#define NO_BLOCK (-1)	// stiva remote goala
+#define CACHE_LINE 64
+
+/*
+	Stiva fara lacat a unei clase. head contine adresa primului bloc in
+	partea de jos si o eticheta in partea de sus, marita la fiecare
+	modificare, ca un bloc scos si pus inapoi intre citirea lui head si
+	compare-and-swap sa nu treaca neobservat (problema ABA).
+*/
+typedef struct class_stack_t {
+	unsigned long long head;
+	int lazy_address;	// primul bloc din zona clasei care nu a fost dat
+	int lazy_count;	// cate blocuri are zona clasei
+	int lazy_used;	// cate blocuri s-au luat din zona
+	// fiecare stiva pe linia ei de cache, ca firele sa nu se incurce
+	char pad[CACHE_LINE - sizeof(long long) - 3 * sizeof(int)];
+} class_stack_t;
+
+typedef struct sfl_arena_t {
+	pthread_mutex_t lock;
+	sfl *heap;
+	int remote;	// ultimul bloc eliberat din alt fir, sau NO_BLOCK
+	class_stack_t *stacks;	// stivele claselor pentru SFL_MT_STACKS, sau NULL
+} sfl_arena_t;
+
+// blocurile eliberate recent de un fir, pe clase de dimensiune
+typedef struct tcache_t {
+	sfl_mt_t *mt;
+	int arena;	// arena din care aloca firul
+	int *count;	// cate blocuri are fiecare clasa
+	int *blocks;	// nr_classes * cache_size adrese
+	struct tcache_t *prev, *next;	// toate cache-urile heap-ului
+} tcache_t;
+
+struct sfl_mt_t {
+	int address;	// inceputul zonei
+	int end;	// sfarsitul zonei
+	int span;	// cati octeti are o arena
+	int lists;	// SFL_MT_SORTED sau SFL_MT_STACKS
+	int nr_arenas;
+	sfl_arena_t *arenas;
+	int nr_classes;	// clasele sunt 8 << 0, ..., 8 << (nr_classes - 1)
+	int cache_size;
+	unsigned char *states;	// pe granula: 0 sau clasa + 1 (| IN_CACHE)
+	pthread_key_t key;	// cache-ul firului curent
+	pthread_mutex_t lock;	// protejeaza lista de cache-uri
+	tcache_t *caches;
+	int next_arena;	// arena data urmatorului fir nou
+};
+
+static unsigned char *block_state(sfl_mt_t *mt, int address)
+{
+	return &mt->states[(address - mt->address) / GRANULE];
+}
+
+static int arena_of(sfl_mt_t *mt, int address)
+{
+	return (address - mt->address) / mt->span;
+}
+
+// cea mai mica clasa ale carei blocuri au cel putin size octeti, sau -1
+static int size_class(sfl_mt_t *mt, int size)
+{
+	if (size <= 0)
+		return -1;
+	for (int c = 0; c < mt->nr_classes; c++)
+		if ((GRANULE << c) >= size)
+			return c;
+	return -1;
+}
+
+// elibereaza un bloc in arena lui; se apeleaza cu lacatul arenei luat
+static void arena_free(sfl_mt_t *mt, sfl_arena_t *arena, int address)
+{
+	sfl_free(arena->heap, address);
+	__atomic_store_n(block_state(mt, address), 0, __ATOMIC_RELEASE);
+}
+
+// elibereaza blocurile puse pe stiva arenei de alte fire
+static void drain_remote(sfl_mt_t *mt, sfl_arena_t *arena)
+{
+	int address = __atomic_exchange_n(&arena->remote, NO_BLOCK,
+									  __ATOMIC_ACQUIRE);
+	while (address != NO_BLOCK) {
+		int next;
+		memcpy(&next, arena_at(arena->heap, address), sizeof(next));
+		arena_free(mt, arena, address);
+		address = next;
+	}
+}
+
+// pune blocul pe stiva arenei lui, fara lacat
+static void push_remote(sfl_arena_t *arena, int address)
+{
+	int head = __atomic_load_n(&arena->remote, __ATOMIC_RELAXED);
+	do {
+		memcpy(arena_at(arena->heap, address), &head, sizeof(head));
+	} while (!__atomic_compare_exchange_n(&arena->remote, &head, address, 1,
+										  __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// legatura spre urmatorul bloc de pe o stiva, in primii 4 octeti ai blocului
+static int *block_link(sfl_arena_t *arena, int address)
+{
+	return (int *)arena_at(arena->heap, address);
+}
+
+static unsigned long long stack_head(unsigned long long old, int address)
+{
+	return ((old >> 32) + 1) << 32 | (unsigned int)address;
+}
+
+static void stack_push(sfl_arena_t *arena, class_stack_t *stack, int address)
+{
+	unsigned long long head = __atomic_load_n(&stack->head, __ATOMIC_RELAXED);
+	do {
+		__atomic_store_n(block_link(arena, address), (int)(unsigned int)head,
+						 __ATOMIC_RELAXED);
+	} while (!__atomic_compare_exchange_n(&stack->head, &head,
+										  stack_head(head, address), 1,
+										  __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+	Scoate primul bloc de pe stiva, sau NO_BLOCK. Legatura se poate citi
+	dintr-un bloc pe care alt fir tocmai l-a scos si il foloseste; atunci
+	eticheta din head s-a schimbat si compare-and-swap esueaza.
+*/
+static int stack_pop(sfl_arena_t *arena, class_stack_t *stack)
+{
+	unsigned long long head = __atomic_load_n(&stack->head, __ATOMIC_ACQUIRE);
+	unsigned long long next;
+	do {
+		int address = (int)(unsigned int)head;
+		if (address == NO_BLOCK)
+			return NO_BLOCK;
+		next = stack_head(head, __atomic_load_n(block_link(arena, address),
+												__ATOMIC_RELAXED));
+	} while (!__atomic_compare_exchange_n(&stack->head, &head, next, 1,
+										  __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+	return (int)(unsigned int)head;
+}
+
+// urmatorul bloc neatins din zona clasei, sau NO_BLOCK
+static int stack_lazy(class_stack_t *stack, int size)
+{
+	int used = __atomic_load_n(&stack->lazy_used, __ATOMIC_RELAXED);
+	do {
+		if (used == stack->lazy_count)
+			return NO_BLOCK;
+	} while (!__atomic_compare_exchange_n(&stack->lazy_used, &used, used + 1,
+										  1, __ATOMIC_RELAXED,
+										  __ATOMIC_RELAXED));
+	return stack->lazy_address + used * size;
+}
+
+/*
+	Aloca fara lacat un bloc de clasa c. Daca clasa nu are blocuri, primul
+	bloc liber dintr-o clasa j mai mare se imparte: primii 8 << c octeti se
+	dau, iar restul se pune pe stive ca bucati de 8 << c, ..., 8 << (j - 1).
+*/
+static int stack_malloc(sfl_mt_t *mt, sfl_arena_t *arena, int c)
+{
+	for (int j = c; j < mt->nr_classes; j++) {
+		int address = stack_pop(arena, &arena->stacks[j]);
+		if (address == NO_BLOCK)
+			address = stack_lazy(&arena->stacks[j], GRANULE << j);
+		if (address == NO_BLOCK)
+			continue;
+		for (int k = j - 1; k >= c; k--)
+			stack_push(arena, &arena->stacks[k], address + (GRANULE << k));
+		return address;
+	}
+	return -1;
+}
+
+// intoarce blocul liber pe stiva clasei lui
+static void stack_free(sfl_mt_t *mt, int address, int c)
+{
+	sfl_arena_t *arena = &mt->arenas[arena_of(mt, address)];
+	__atomic_store_n(block_state(mt, address), 0, __ATOMIC_RELEASE);
+	stack_push(arena, &arena->stacks[c], address);
+}
+
+/*
+	Aloca din arena pana la n blocuri de clasa c, puse in blocks, si
+	returneaza cate s-au alocat. Arenele cu liste sfl le aloca cu cate un
+	MALLOC_N pentru fiecare BATCH_SIZE blocuri, sub lacat; adresele vin pe
+	64 de biti si se copiaza in blocks.
+*/
+static int arena_take(sfl_mt_t *mt, sfl_arena_t *arena, int c, int *blocks,
+					  int n)
+{
+	int taken = 0;
+	if (arena->stacks) {
+		while (taken < n && (blocks[taken] = stack_malloc(mt, arena, c)) != -1)
+			taken++;
+		return taken;
+	}
+
+	sfl_addr_t batch[BATCH_SIZE];
+	pthread_mutex_lock(&arena->lock);
+	drain_remote(mt, arena);
+	for (int done = 0; done < n; done += BATCH_SIZE) {
+		int want = n - done < BATCH_SIZE ? n - done : BATCH_SIZE;
+		int got = sfl_malloc_n(arena->heap, GRANULE << c, want, batch);
+		for (int i = 0; i < got; i++)
+			blocks[taken + i] = batch[i];
+		taken = taken + got;
+	}
+	pthread_mutex_unlock(&arena->lock);
+	return taken;
+}
+
+// goleste cache-ul unui fir in arena lui
+static void tcache_flush(tcache_t *tc)
+{
+	sfl_mt_t *mt = tc->mt;
+	sfl_arena_t *arena = &mt->arenas[tc->arena];
+	if (mt->lists == SFL_MT_STACKS) {
+		for (int c = 0; c < mt->nr_classes; c++) {
+			for (int i = 0; i < tc->count[c]; i++)
+				stack_free(mt, tc->blocks[c * mt->cache_size + i], c);
+			tc->count[c] = 0;
+		}
+		return;
+	}
+	pthread_mutex_lock(&arena->lock);
+	for (int c = 0; c < mt->nr_classes; c++) {
+		for (int i = 0; i < tc->count[c]; i++)
+			arena_free(mt, arena, tc->blocks[c * mt->cache_size + i]);
+		tc->count[c] = 0;
+	}
+	drain_remote(mt, arena);
+	pthread_mutex_unlock(&arena->lock);
+}
+
+static void tcache_destroy(tcache_t *tc)
+{
+	free(tc->count);
+	free(tc->blocks);
+	free(tc);
+}
+
+// la terminarea unui fir, blocurile din cache-ul lui se intorc in arena
+static void tcache_exit(void *data)
+{
+	tcache_t *tc = data;
+	sfl_mt_t *mt = tc->mt;
+	tcache_flush(tc);
+	pthread_mutex_lock(&mt->lock);
+	if (tc->prev)
+		tc->prev->next = tc->next;
+	else
+		mt->caches = tc->next;
+	if (tc->next)
+		tc->next->prev = tc->prev;
+	pthread_mutex_unlock(&mt->lock);
+	tcache_destroy(tc);
+}
+
+// cache-ul firului curent, creat la prima folosire
+static tcache_t *thread_cache(sfl_mt_t *mt)
+{
+	tcache_t *tc = pthread_getspecific(mt->key);
+	if (tc)
+		return tc;
+
+	tc = malloc(sizeof(*tc));
+	DIE(!tc, "malloc failed...");
+	tc->mt = mt;
+	tc->count = calloc(mt->nr_classes, sizeof(int));
+	tc->blocks = malloc(mt->nr_classes * (mt->cache_size + 1) * sizeof(int));
+	DIE(!tc->count || !tc->blocks, "malloc failed...");
+	pthread_mutex_lock(&mt->lock);
+	tc->arena = mt->next_arena;
+	mt->next_arena = (mt->next_arena + 1) % mt->nr_arenas;
+	tc->prev = NULL;
+	tc->next = mt->caches;
+	if (mt->caches)
+		mt->caches->prev = tc;
+	mt->caches = tc;
+	pthread_mutex_unlock(&mt->lock);
+	pthread_setspecific(mt->key, tc);
+	return tc;
+}
+
+sfl_mt_t *sfl_mt_create(int address, int nr_lists, int nr_bytes, int type,
+						int lists, int nr_arenas, int cache_size)
+{
+	// fiecare arena trebuie sa aiba cel putin un bloc din fiecare lista
+	if (nr_lists <= 0 || nr_arenas <= 0 || cache_size < 0 || address < 0 ||
+		nr_bytes / nr_arenas < (GRANULE << (nr_lists - 1)))
+		return NULL;
+	// stivele nu pastreaza ordinea adreselor, deci nu se pot reuni blocuri
+	if (lists != SFL_MT_SORTED && (lists != SFL_MT_STACKS || type != 0))
+		return NULL;
+
+	sfl_mt_t *mt = malloc(sizeof(*mt));
+	DIE(!mt, "malloc failed...");
+	mt->address = address;
+	mt->lists = lists;
+	mt->nr_arenas = nr_arenas;
+	mt->nr_classes = nr_lists;
+	mt->cache_size = cache_size;
+	mt->caches = NULL;
+	mt->next_arena = 0;
+	mt->arenas = malloc(nr_arenas * sizeof(sfl_arena_t));
+	DIE(!mt->arenas, "malloc failed...");
+
+	/*
+		Arenele au aceeasi impartire pe liste ca heap-ul intreg; bytes se
+		rotunjesc la cel mai mare bloc ca arenele sa fie egale.
+	*/
+	int largest = GRANULE << (nr_lists - 1);
+	int arena_bytes = nr_bytes / nr_arenas / largest * largest;
+	for (int i = 0; i < nr_arenas; i++) {
+		sfl_arena_t *arena = &mt->arenas[i];
+		sfl *heap = sfl_init(address, nr_lists, arena_bytes, type,
+							 POLICY_BEST);
+		if (i == 0)
+			mt->span = heap->regions[nr_lists] - address;
+		address = heap->regions[nr_lists];
+
+		arena->heap = heap;
+		arena->remote = NO_BLOCK;
+		arena->stacks = NULL;
+		if (lists == SFL_MT_STACKS) {
+			DIE(posix_memalign((void **)&arena->stacks, CACHE_LINE,
+							   nr_lists * sizeof(class_stack_t)),
+				"posix_memalign failed...");
+			for (int c = 0; c < nr_lists; c++) {
+				arena->stacks[c].head = (unsigned int)NO_BLOCK;
+				arena->stacks[c].lazy_address = heap->regions[c];
+				arena->stacks[c].lazy_count = (heap->regions[c + 1] -
+											   heap->regions[c]) >> (c + 3);
+				arena->stacks[c].lazy_used = 0;
+			}
+		}
+		pthread_mutex_init(&arena->lock, NULL);
+	}
+	mt->end = address;
+	mt->states = calloc((mt->end - mt->address) / GRANULE, 1);
+	DIE(!mt->states, "calloc failed...");
+	pthread_mutex_init(&mt->lock, NULL);
+	DIE(pthread_key_create(&mt->key, tcache_exit), "pthread_key_create");
+	return mt;
+}
+
+// se apeleaza dupa ce s-au oprit toate firele care folosesc heap-ul
+void sfl_mt_destroy(sfl_mt_t *mt)
+{
+	pthread_key_delete(mt->key);
+	while (mt->caches) {
+		tcache_t *tc = mt->caches;
+		mt->caches = tc->next;
+		tcache_destroy(tc);
+	}
+	for (int i = 0; i < mt->nr_arenas; i++) {
+		sfl_destroy(mt->arenas[i].heap);
+		free(mt->arenas[i].stacks);
+		pthread_mutex_destroy(&mt->arenas[i].lock);
+	}
+	pthread_mutex_destroy(&mt->lock);
+	free(mt->arenas);
+	free(mt->states);
+	free(mt);
+}
+
+/*
+	Aloca un bloc de cel putin size octeti si returneaza adresa lui. Cand
+	cache-ul clasei e gol, se iau din arena firului jumatate de cache de
+	blocuri deodata; daca arena nu mai are memorie se incearca celelalte.
+*/
+int sfl_mt_malloc(sfl_mt_t *mt, int size)
+{
+	int c = size_class(mt, size);
+	if (c == -1)
+		return -1;
+	tcache_t *tc = thread_cache(mt);
+	int *bin = tc->blocks + c * mt->cache_size;
+	int address = -1;
+
+	if (tc->count[c]) {
+		address = bin[--tc->count[c]];
+	} else {
+		// blocul cerut si inca jumatate de cache, puse direct in cache
+		int taken = arena_take(mt, &mt->arenas[tc->arena], c, bin,
+							   1 + mt->cache_size / 2);
+		for (int i = 1; !taken && i < mt->nr_arenas; i++)
+			taken = arena_take(mt, &mt->arenas[(tc->arena + i) %
+											   mt->nr_arenas], c, bin, 1);
+		if (!taken)
+			return -1;
+		address = bin[--taken];
+		for (int i = 0; i < taken; i++)
+			__atomic_store_n(block_state(mt, bin[i]), (c + 1) | IN_CACHE,
+							 __ATOMIC_RELAXED);
+		tc->count[c] = taken;
+	}
+	__atomic_store_n(block_state(mt, address), c + 1, __ATOMIC_RELEASE);
+	return address;
+}
+
+/*
+	Aloca count blocuri de cel putin size octeti, puse in addresses, si
+	returneaza cate s-au putut aloca. Blocurile se iau intai din cache, iar
+	restul deodata din arena firului, apoi din celelalte.
+*/
+int sfl_mt_malloc_n(sfl_mt_t *mt, int size, int count, int *addresses)
+{
+	int c = size_class(mt, size);
+	if (c == -1)
+		return 0;
+	tcache_t *tc = thread_cache(mt);
+	int *bin = tc->blocks + c * mt->cache_size;
+	int taken = 0;
+	while (taken < count && tc->count[c])
+		addresses[taken++] = bin[--tc->count[c]];
+	for (int i = 0; taken < count && i < mt->nr_arenas; i++)
+		taken += arena_take(mt, &mt->arenas[(tc->arena + i) % mt->nr_arenas],
+							c, addresses + taken, count - taken);
+	for (int i = 0; i < taken; i++)
+		__atomic_store_n(block_state(mt, addresses[i]), c + 1,
+						 __ATOMIC_RELEASE);
+	return taken;
+}
+
+/*
+	Elibereaza blocul care incepe la address; returneaza -1 daca acolo nu
+	incepe un bloc alocat (adresa gresita sau bloc deja eliberat).
+*/
+int sfl_mt_free(sfl_mt_t *mt, int address)
+{
+	if (address < mt->address || address >= mt->end ||
+		(address - mt->address) % GRANULE)
+		return -1;
+	unsigned char *state = block_state(mt, address);
+	unsigned char old = __atomic_load_n(state, __ATOMIC_ACQUIRE);
+	do {
+		if (old == 0 || (old & IN_CACHE))
+			return -1;
+	} while (!__atomic_compare_exchange_n(state, &old, old | IN_CACHE, 1,
+										  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	int c = old - 1;
+	tcache_t *tc = thread_cache(mt);
+	int *bin = tc->blocks + c * mt->cache_size;
+	if (mt->lists == SFL_MT_STACKS) {
+		// orice fir poate pune blocul pe stiva arenei lui
+		if (tc->count[c] == mt->cache_size) {
+			while (tc->count[c] > mt->cache_size / 2)
+				stack_free(mt, bin[--tc->count[c]], c);
+			if (mt->cache_size == 0) {
+				stack_free(mt, address, c);
+				return 0;
+			}
+		}
+		bin[tc->count[c]++] = address;
+		return 0;
+	}
+
+	int index = arena_of(mt, address);
+	sfl_arena_t *arena = &mt->arenas[index];
+	if (index != tc->arena) {	// blocul e al altei arene
+		push_remote(arena, address);
+		return 0;
+	}
+
+	if (tc->count[c] == mt->cache_size) {
+		// cache-ul e plin: jumatate din el, si blocul, se intorc in arena
+		pthread_mutex_lock(&arena->lock);
+		while (tc->count[c] > mt->cache_size / 2)
+			arena_free(mt, arena, bin[--tc->count[c]]);
+		if (mt->cache_size == 0)
+			arena_free(mt, arena, address);
+		drain_remote(mt, arena);
+		pthread_mutex_unlock(&arena->lock);
+		if (mt->cache_size == 0)
+			return 0;
+	}
+	bin[tc->count[c]++] = address;
+	return 0;
+}
+
+// returneaza cate dintre blocuri s-au eliberat
+int sfl_mt_free_n(sfl_mt_t *mt, int *addresses, int count)
+{
+	int freed = 0;
+	for (int i = 0; i < count; i++)
+		if (sfl_mt_free(mt, addresses[i]) == 0)
+			freed++;
+	return freed;
+}
+
+/*
+	Verifica dupa states ca [address, address + n) se afla in blocuri alocate
+	consecutive din arena (pentru SFL_MT_STACKS, unde arenele nu au lista de
+	blocuri alocate). Blocul care contine address incepe cu cel mult cel mai
+	mare bloc inaintea ei.
+*/
+static int allocated_run(sfl_mt_t *mt, sfl_arena_t *arena, int address, int n)
+{
+	int first = arena->heap->regions[0];
+	int last = arena->heap->regions[mt->nr_classes];
+	int largest = GRANULE << (mt->nr_classes - 1);
+	int start = address - (address - mt->address) % GRANULE;
+	unsigned char state = 0;
+	while (start >= first && start > address - largest &&
+		   !(state = __atomic_load_n(block_state(mt, start), __ATOMIC_ACQUIRE)))
+		start = start - GRANULE;
+	if (!state)
+		return 0;
+	int end = start + (GRANULE << ((state & ~IN_CACHE) - 1));
+	if (end <= address)
+		return 0;
+	while (end < address + n) {
+		if (end >= last)
+			return 0;
+		state = __atomic_load_n(block_state(mt, end), __ATOMIC_ACQUIRE);
+		if (!state)
+			return 0;
+		end = end + (GRANULE << ((state & ~IN_CACHE) - 1));
+	}
+	return 1;
+}
+
+/*
+	Verifica sub lacatul arenei ca [address, address + n) se afla in blocuri
+	alocate consecutive si returneaza arena, sau NULL. Blocurile din cache-uri
+	raman alocate in arena, ca la orice alocator cu cache, deci nu sunt
+	respinse. Arenele cu stive nu au lacat, iar verificarea se face dupa
+	states.
+*/
+static sfl_arena_t *lock_area(sfl_mt_t *mt, int address, int n)
+{
+	if (n < 0 || address < mt->address || address >= mt->end)
+		return NULL;
+	sfl_arena_t *arena = &mt->arenas[arena_of(mt, address)];
+	if (arena->stacks)
+		return allocated_run(mt, arena, address, n) ? arena : NULL;
+	pthread_mutex_lock(&arena->lock);
+	if (!continuos_area(arena->heap, n, address)) {
+		pthread_mutex_unlock(&arena->lock);
+		return NULL;
+	}
+	return arena;
+}
+
+static void unlock_area(sfl_arena_t *arena)
+{
+	if (!arena->stacks)
+		pthread_mutex_unlock(&arena->lock);
+}
+
+int sfl_mt_read(sfl_mt_t *mt, int address, char *buf, int n)
+{
+	sfl_arena_t *arena = lock_area(mt, address, n);
+	if (!arena)
+		return -1;
+	memcpy(buf, arena_at(arena->heap, address), n);
+	unlock_area(arena);
+	return 0;
+}
+
+int sfl_mt_write(sfl_mt_t *mt, int address, const char *buf, int n)
+{
+	sfl_arena_t *arena = lock_area(mt, address, n);
+	if (!arena)
+		return -1;
+	memcpy(arena_at(arena->heap, address), buf, n);
+	unlock_area(arena);
+	return 0;
+}